@@ -19,10 +19,32 @@
  */
 
 #include "document.h"
+#include "documentcache.h"
 #include "viewer.h"
 
 #include <QApplication>
-#include <QProgressDialog>
+#include <QCryptographicHash>
+#include <QDataStream>
+
+#include <algorithm>
+
+// number of cells per dimension of the grid used for link hit testing
+#define LinkGridSize 16
+
+// pages with less links are just scanned linearly
+#define LinkGridMinLinks 16
+
+// documents with more pages get provisional page sizes on a cold open
+#define ProvisionalPageSizesLimit 64
+
+// resolution of the render that covers graphics, colors and fonts in the page fingerprints, antialiased to catch changes below a pixel
+#define FingerprintResolution 72.0
+
+// each background worker loads the document on its own, only worth it for larger documents
+static int backgroundWorkers(int numPages)
+{
+    return qBound(1, numPages / 64, QThread::idealThreadCount());
+}
 
 Document::Document()
 {
@@ -34,16 +56,183 @@ Document::~Document()
     reset();
 }
 
-void Document::setDocument(std::unique_ptr<Poppler::Document> &&document, QProgressDialog *pd)
+std::unique_ptr<Poppler::Document> Document::loadPopplerDocument(const QString &fileName, MappedFile *mappedFile, std::unique_ptr<QIODevice> &device)
+{
+    // prefer the mapping, fallback to normal loading if that fails
+    std::unique_ptr<Poppler::Document> document;
+    device.reset();
+    if (mappedFile) {
+        device = mappedFile->device();
+        document = Poppler::Document::load(device.get());
+        if (!document)
+            device.reset();
+    }
+    if (!document)
+        document = Poppler::Document::load(fileName);
+
+    // the fingerprint renders of the worker documents must match the ones of earlier loads
+    if (document) {
+        document->setRenderHint(Poppler::Document::TextAntialiasing, true);
+        document->setRenderHint(Poppler::Document::Antialiasing, true);
+    }
+    return document;
+}
+
+void Document::prepare(QPromise<std::unique_ptr<Prepared>> &promise, const QString &fileName, std::shared_ptr<MappedFile> mappedFile, bool fingerprintPages, int targetPage)
+{
+    // stage 1: parse
+    promise.setProgressValueAndText(0, QStringLiteral("Loading document..."));
+    std::unique_ptr<QIODevice> device;
+    std::unique_ptr<Poppler::Document> document = loadPopplerDocument(fileName, mappedFile.get(), device);
+    if (promise.isCanceled())
+        return;
+    if (!document || document->isLocked()) {
+        promise.addResult(nullptr);
+        return;
+    }
+
+    auto prepared = std::make_unique<Prepared>();
+    prepared->mappedFile = std::move(mappedFile);
+    prepared->device = std::move(device);
+    prepared->document = std::move(document);
+    prepared->fileName = fileName;
+    prepared->fingerprint = DocumentCache::fingerprint(fileName);
+
+    // warm open: take page sizes, links and toc from the cache if the file is unchanged
+    const int numPages = prepared->document->numPages();
+    DocumentCache::Data cached;
+    if (DocumentCache::load(fileName, prepared->fingerprint, cached) && cached.pageSizes.size() == numPages) {
+        prepared->pageSizes = std::move(cached.pageSizes);
+        prepared->links.resize(numPages);
+        for (int i = 0; i < numPages; ++i)
+            prepared->links[i] = indexLinks(std::move(cached.links[i]));
+        prepared->toc = std::move(cached.toc);
+        prepared->pageFingerprints = std::move(cached.pageFingerprints);
+        prepared->fromCache = true;
+        promise.addResult(std::move(prepared));
+        return;
+    }
+
+    // stage 2: page sizes, the layout and links follow in setDocument() and the background workers
+    promise.setProgressRange(0, fingerprintPages ? 2 * numPages : numPages);
+    promise.setProgressValueAndText(0, QStringLiteral("Measuring pages..."));
+
+    // we only need the page sizes for the layout, don't keep the poppler pages around
+    // large documents on a cold open: measure just the first and the target page, the others most likely have the size of the first one,
+    // the link extraction workers measure them in the background, reloads need the exact sizes for the fingerprints
+    const bool provisional = !fingerprintPages && numPages > ProvisionalPageSizesLimit;
+    prepared->pageSizes.resize(numPages);
+    if (provisional)
+        prepared->provisionalPageSizes.assign(numPages, true);
+    for (int i = 0; i < numPages; ++i) {
+        if (promise.isCanceled())
+            return;
+        promise.setProgressValue(i);
+
+        if (provisional && i != 0 && i != targetPage) {
+            prepared->pageSizes[i] = prepared->pageSizes[0];
+            continue;
+        }
+
+        // invalid pages keep an empty size
+        if (std::unique_ptr<Poppler::Page> page = prepared->document->page(i))
+            prepared->pageSizes[i] = page->pageSizeF();
+        if (provisional)
+            prepared->provisionalPageSizes[i] = false;
+    }
+
+    // reload: fingerprint all pages in parallel to find out which ones stayed the same, the old document is still shown meanwhile
+    if (fingerprintPages) {
+        promise.setProgressValueAndText(numPages, QStringLiteral("Comparing pages..."));
+        prepared->pageFingerprints.resize(numPages);
+        std::atomic<int> nextPage = 0;
+        std::atomic<int> donePages = 0;
+        QThreadPool pool;
+        const int workers = backgroundWorkers(numPages);
+        pool.setMaxThreadCount(workers);
+        for (int w = 0; w < workers; ++w) {
+            pool.start([&]() {
+                // own Poppler document per worker, invalid pages or failed loads leave empty fingerprints that never match
+                std::unique_ptr<QIODevice> device;
+                std::unique_ptr<Poppler::Document> document = loadPopplerDocument(fileName, prepared->mappedFile.get(), device);
+                if (!document || document->numPages() != numPages)
+                    return;
+
+                for (int i = nextPage++; i < numPages && !promise.isCanceled(); i = nextPage++) {
+                    if (std::unique_ptr<Poppler::Page> page = document->page(i))
+                        prepared->pageFingerprints[i] = fingerprintPage(page.get(), extractLinks(page.get()));
+                    promise.setProgressValue(numPages + ++donePages);
+                }
+            });
+        }
+        pool.waitForDone();
+        if (promise.isCanceled())
+            return;
+    }
+
+    promise.addResult(std::move(prepared));
+}
+
+void Document::restore(QPromise<std::unique_ptr<Prepared>> &promise, std::unique_ptr<Prepared> prepared, std::shared_ptr<MappedFile> mappedFile)
+{
+    promise.setProgressValueAndText(0, QStringLiteral("Loading document..."));
+
+    // sizes and links are only valid for the unchanged file
+    if (DocumentCache::fingerprint(prepared->fileName) != prepared->fingerprint) {
+        promise.addResult(nullptr);
+        return;
+    }
+
+    std::unique_ptr<QIODevice> device;
+    std::unique_ptr<Poppler::Document> document = loadPopplerDocument(prepared->fileName, mappedFile.get(), device);
+    if (promise.isCanceled())
+        return;
+    if (!document || document->isLocked() || document->numPages() != prepared->pageSizes.size()) {
+        promise.addResult(nullptr);
+        return;
+    }
+
+    prepared->mappedFile = std::move(mappedFile);
+    prepared->device = std::move(device);
+    prepared->document = std::move(document);
+    promise.addResult(std::move(prepared));
+}
+
+void Document::setDocument(std::unique_ptr<Prepared> prepared)
 {
+    // reload with fingerprinted pages: keep the links of the pages with unchanged content
+    std::vector<bool> unchangedPages;
+    std::vector<PageLinks> unchangedLinks;
+    std::vector<bool> unchangedLinksExtracted;
+    if (prepared && !prepared->pageFingerprints.empty()) {
+        // workers access our vectors
+        stopLinkExtraction();
+
+        const size_t newPages = prepared->pageFingerprints.size();
+        unchangedPages.resize(newPages, false);
+        unchangedLinks.resize(newPages);
+        unchangedLinksExtracted.resize(newPages, false);
+        for (size_t i = 0; i < qMin(newPages, m_pageFingerprints.size()); ++i) {
+            if (m_pageFingerprints[i].isEmpty() || m_pageFingerprints[i] != prepared->pageFingerprints[i])
+                continue;
+
+            unchangedPages[i] = true;
+            unchangedLinks[i] = std::move(m_links[i]);
+            unchangedLinksExtracted[i] = m_linksExtracted[i];
+        }
+    }
+
     // reset old content
     reset();
 
-    // remember new poppler document
-    m_document = std::move(document);
-
     // passing a nullptr is valid as it only resets the object
-    if (m_document) {
+    if (prepared) {
+        // remember new poppler document and the mapping it might use
+        m_mappedFile = std::move(prepared->mappedFile);
+        m_device = std::move(prepared->device);
+        m_document = std::move(prepared->document);
+        m_fingerprint = prepared->fingerprint;
+
         // remember title
         m_title = m_document->title();
 
@@ -52,34 +241,47 @@ void Document::setDocument(std::unique_ptr<Poppler::Document> &&document, QProgr
         m_document->setRenderHint(Poppler::Document::Antialiasing, true);
         m_document->setRenderBackend(Poppler::Document::SplashBackend);
 
-        // init progress dialog
-        if (pd) {
-            pd->setLabelText(QStringLiteral("Processing pages..."));
-            pd->setRange(0, m_document->numPages());
-        }
-
-        // reserve space for data
-        m_pages.resize(m_document->numPages());
-        m_links.resize(m_document->numPages());
-        m_pageRects.resize(m_document->numPages());
-
-        // create all poppler pages and collect links on them
-        for (int i = 0; i < m_document->numPages(); ++i) {
-            // update progress dialog
-            if (pd)
-                pd->setValue(i);
-
-            // skip invalid pages
-            std::unique_ptr<Poppler::Page> page = m_document->page(i);
-            if (!page)
-                continue;
-
-            // extract links from the page
-            auto links = page->annotations(QSet<Poppler::Annotation::SubType>() << Poppler::Annotation::ALink << Poppler::Annotation::AText << Poppler::Annotation::ACaret);
-            m_links[i] = std::move(links);
-
-            // remember the page
-            m_pages[i] = std::move(page);
+        // reserve space for data, pages are created on demand
+        m_pageSizes = std::move(prepared->pageSizes);
+        m_pages.resize(numPages());
+
+        // provisional sizes are measured by the background workers
+        m_provisionalPageSizes = std::move(prepared->provisionalPageSizes);
+        if (!m_provisionalPageSizes.empty())
+            m_measuredPageSizes = m_pageSizes;
+
+        // fingerprints are complete if taken from the cache, computed for a reload or else filled by the background workers
+        m_pageFingerprints = std::move(prepared->pageFingerprints);
+        m_pageFingerprints.resize(numPages());
+        m_unchangedPages = std::move(unchangedPages);
+
+        // lookups of a document taken back before
+        m_namedDestinations = std::move(prepared->namedDestinations);
+
+        if (prepared->fromCache) {
+            m_links = std::move(prepared->links);
+            m_linksExtracted.assign(numPages(), true);
+            m_toc = std::move(prepared->toc);
+            m_tocLoaded = true;
+
+            // all names used in the document are known at once
+            QMutexLocker locker(&m_pageMutex);
+            for (const PageLinks &pageLinks : m_links)
+                addNamedDestinationsLocked(pageLinks.links);
+            addNamedDestinationsLocked(m_toc);
+        } else {
+            // links are created on demand or by the background workers, they will fill the cache
+            if (!unchangedLinks.empty()) {
+                m_links = std::move(unchangedLinks);
+                m_linksExtracted = std::move(unchangedLinksExtracted);
+
+                QMutexLocker locker(&m_pageMutex);
+                for (const PageLinks &pageLinks : m_links)
+                    addNamedDestinationsLocked(pageLinks.links);
+            }
+            m_links.resize(numPages());
+            m_linksExtracted.resize(numPages(), false);
+            startLinkExtraction(prepared->fileName);
         }
     }
 
@@ -94,21 +296,61 @@ void Document::setDocument(std::unique_ptr<Poppler::Document> &&document, QProgr
     emit documentChanged();
 }
 
-QVector<Poppler::OutlineItem> Document::toc() const
+std::unique_ptr<Document::Prepared> Document::takeDocument()
 {
     if (!m_document)
-        return QVector<Poppler::OutlineItem>();
+        return nullptr;
+
+    // workers access our vectors
+    stopLinkExtraction();
+
+    auto prepared = std::make_unique<Prepared>();
+    prepared->mappedFile = m_mappedFile;
+    prepared->fingerprint = m_fingerprint;
+    prepared->pageSizes = m_pageSizes;
+    prepared->provisionalPageSizes = m_provisionalPageSizes;
+    prepared->pageFingerprints = m_pageFingerprints;
+    prepared->namedDestinations = m_namedDestinations;
+
+    // complete links and sizes need no workers later, like a document from the cache, else they start again
+    if (m_provisionalPageSizes.empty() && std::all_of(m_linksExtracted.cbegin(), m_linksExtracted.cend(), [](bool extracted) { return extracted; })) {
+        prepared->fromCache = true;
+        prepared->toc = toc();
+        prepared->links = std::move(m_links);
+    }
+
+    // the pages are no longer needed, they are created again on demand
+    prepared->device = std::move(m_device);
+    prepared->document = std::move(m_document);
+    setDocument(nullptr);
+    return prepared;
+}
+
+QVector<Document::TocItem> Document::toc() const
+{
+    if (!m_document)
+        return QVector<TocItem>();
+
+    if (!m_tocLoaded) {
+        m_toc = tocFromOutline(m_document->outline());
+        m_tocLoaded = true;
+
+        QMutexLocker locker(&m_pageMutex);
+        addNamedDestinationsLocked(m_toc);
+    }
 
-    return m_document->outline();
+    return m_toc;
 }
 
 QList<int> Document::visiblePages(const QRectF &rect) const
 {
     QList<int> pages;
 
-    for (int c = 0; c < m_pageRects.size(); c++)
-        if (m_pageRects.at(c).intersects(rect))
-            pages << c;
+    // only check the rows overlapping the rectangle vertically
+    for (int row = firstRowBelow(rect.top()); row < m_rows.size() && m_rows.at(row).top <= rect.bottom(); ++row)
+        for (int c = m_rows.at(row).firstPage; c <= m_rows.at(row).lastPage; ++c)
+            if (m_pageRects.at(c).intersects(rect))
+                pages << c;
 
     return pages;
 }
@@ -121,9 +363,12 @@ QRectF Document::pageRect(int page, bool addMargins) const
 
 int Document::pageForPoint(const QPointF &point) const
 {
-    for (int c = 0; c < m_pageRects.size(); c++)
-        if (m_pageRects.at(c).marginsAdded(QMarginsF(m_spacing, m_spacing, m_spacing, 0)).contains(point))
-            return c;
+    // the point can be in the row itself or in the spacing above the next one
+    const int firstRow = firstRowBelow(point.y());
+    for (int row = firstRow; row < qMin(int(m_rows.size()), firstRow + 2); ++row)
+        for (int c = m_rows.at(row).firstPage; c <= m_rows.at(row).lastPage; ++c)
+            if (m_pageRects.at(c).marginsAdded(QMarginsF(m_spacing, m_spacing, m_spacing, 0)).contains(point))
+                return c;
 
     return -1;
 }
@@ -133,7 +378,7 @@ int Document::pageForRect(const QRectF &rect) const
     int foundPage = -1;
     qreal currentArea = 0;
 
-    for (int page = 0; page < numPages(); page++) {
+    for (int page : visiblePages(rect)) {
         QRectF r = rect.intersected(pageRect(page));
         if (currentArea < r.width() * r.height()) {
             currentArea = r.width() * r.height();
@@ -144,23 +389,84 @@ int Document::pageForRect(const QRectF &rect) const
     return foundPage;
 }
 
+bool Document::keptUnchangedPages() const
+{
+    return std::find(m_unchangedPages.cbegin(), m_unchangedPages.cend(), true) != m_unchangedPages.cend();
+}
+
 Poppler::Page *Document::page(int page) const
 {
-    if (page >= 0 && size_t(page) < m_pages.size())
-        return m_pages.at(page).get();
+    if (page < 0 || size_t(page) >= m_pages.size())
+        return nullptr;
+
+    QMutexLocker locker(&m_pageMutex);
+    return pageLocked(page);
+}
+
+const std::vector<Document::Link> &Document::links(int page) const
+{
+    return pageLinks(page).links;
+}
+
+const Document::Link *Document::linkAt(int page, const QPointF &point) const
+{
+    const PageLinks &indexed = pageLinks(page);
+
+    // few links => no grid, check all
+    if (indexed.grid.empty()) {
+        for (const Link &link : indexed.links)
+            if (link.boundary.contains(point))
+                return &link;
+        return nullptr;
+    }
+
+    // else only check the links overlapping the cell of the point, they are in document order
+    const int x = qBound(0, int(point.x() * LinkGridSize), LinkGridSize - 1);
+    const int y = qBound(0, int(point.y() * LinkGridSize), LinkGridSize - 1);
+    for (int index : indexed.grid.at(y * LinkGridSize + x))
+        if (indexed.links.at(index).boundary.contains(point))
+            return &indexed.links.at(index);
 
     return nullptr;
 }
 
-const std::vector<std::unique_ptr<Poppler::Annotation>> &Document::links(int page) const
+const Document::PageLinks &Document::pageLinks(int page) const
 {
     Q_ASSERT(page >= 0 && size_t(page) < m_links.size());
+
+    QMutexLocker locker(&m_pageMutex);
+    if (!m_linksExtracted[page]) {
+        // background workers not done with this page, extract links on our own, skip invalid pages
+        if (Poppler::Page *p = pageLocked(page)) {
+            m_links[page] = indexLinks(extractLinks(p));
+            addNamedDestinationsLocked(m_links[page].links);
+        }
+        m_linksExtracted[page] = true;
+    }
+
     return m_links.at(page);
 }
 
-std::unique_ptr<Poppler::LinkDestination> Document::linkDestination(const QString &destination) const
+QString Document::resolveDestination(const QString &name) const
 {
-    return m_document->linkDestination(destination);
+    if (!m_document)
+        return QString();
+
+    {
+        QMutexLocker locker(&m_pageMutex);
+        auto it = m_namedDestinations.constFind(name);
+        if (it != m_namedDestinations.cend())
+            return it.value();
+    }
+
+    // walk the name tree once, remember unknown or bogus names, too
+    QString destination;
+    if (std::unique_ptr<Poppler::LinkDestination> link = m_document->linkDestination(name); link && link->pageNumber() > 0)
+        destination = link->toString();
+
+    QMutexLocker locker(&m_pageMutex);
+    m_namedDestinations.insert(name, destination);
+    return destination;
 }
 
 void Document::setDoubleSided(bool on)
@@ -177,6 +483,7 @@ void Document::setDoubleSided(bool on)
 void Document::relayout()
 {
     m_pageRects.clear();
+    m_rows.clear();
     m_layoutSize = QSizeF();
 
     if (m_document == nullptr)
@@ -189,8 +496,7 @@ void Document::relayout()
 
         int currentPage = 0;
         while (currentPage < numPages()) {
-            Poppler::Page *p = page(currentPage);
-            QRectF pageRect = QRectF(QPointF(), p->pageSizeF());
+            QRectF pageRect = QRectF(QPointF(), pageSize(currentPage));
             qreal pageHeight = pageRect.height();
 
             // special handling for first page in documents with more than 2 pages
@@ -204,8 +510,7 @@ void Document::relayout()
 
                 // check right side, center last page if single
                 if (currentPage < numPages()) {
-                    p = page(currentPage);
-                    pageRect = QRectF(QPointF(), p->pageSizeF()).translated(offset + QPointF(pageRect.width(), 0));
+                    pageRect = QRectF(QPointF(), pageSize(currentPage)).translated(offset + QPointF(pageRect.width(), 0));
 
                     // ensure pages are vertically centered
                     if (pageRect.height() > m_pageRects.last().height()) {
@@ -250,9 +555,7 @@ void Document::relayout()
         qreal maxWidth = 0.0;
 
         for (int i = 0; i < numPages(); ++i) {
-            Poppler::Page *p = page(i);
-
-            QRectF pageRect = QRectF(QPointF(), p->pageSizeF()).translated(offset);
+            QRectF pageRect = QRectF(QPointF(), pageSize(i)).translated(offset);
             m_pageRects << pageRect;
 
             offset += QPointF(0, pageRect.height() + m_spacing);
@@ -267,6 +570,19 @@ void Document::relayout()
         }
     }
 
+    /**
+     * group pages into rows, pages of one row overlap vertically, rows don't
+     */
+    for (int c = 0; c < m_pageRects.size(); c++) {
+        const QRectF &r = m_pageRects.at(c);
+        if (!m_rows.isEmpty() && r.top() < m_rows.last().bottom) {
+            m_rows.last().top = qMin(m_rows.last().top, r.top());
+            m_rows.last().bottom = qMax(m_rows.last().bottom, r.bottom());
+            m_rows.last().lastPage = c;
+        } else
+            m_rows << Row{r.top(), r.bottom(), c, c};
+    }
+
     /**
      * compute full layout size
      */
@@ -281,10 +597,283 @@ void Document::relayout()
     emit layoutChanged();
 }
 
+int Document::firstRowBelow(qreal y) const
+{
+    return std::lower_bound(m_rows.cbegin(), m_rows.cend(), y, [](const Row &row, qreal value) { return row.bottom < value; }) - m_rows.cbegin();
+}
+
 void Document::reset()
 {
+    // workers access our vectors
+    stopLinkExtraction();
+
     m_links.clear();
+    m_linksExtracted.clear();
+    m_pageFingerprints.clear();
+    m_unchangedPages.clear();
     m_pages.clear();
+    m_pageSizes.clear();
+    m_provisionalPageSizes.clear();
+    m_measuredPageSizes.clear();
+    m_toc.clear();
+    m_tocLoaded = false;
+    m_namedDestinations.clear();
+    m_fingerprint.clear();
     m_title.clear();
     m_document.reset();
+    m_device.reset();
+    m_mappedFile.reset();
+}
+
+Poppler::Page *Document::pageLocked(int page) const
+{
+    // create the poppler page on first use
+    if (!m_pages[page])
+        m_pages[page] = m_document->page(page);
+
+    return m_pages[page].get();
+}
+
+void Document::startLinkExtraction(const QString &fileName)
+{
+    const int workers = backgroundWorkers(numPages());
+    m_linkExtractionPool.setMaxThreadCount(workers);
+
+    m_nextLinkExtractionPage = 0;
+    m_abortLinkExtraction = false;
+    m_runningLinkExtractionWorkers = workers;
+    for (int i = 0; i < workers; ++i)
+        m_linkExtractionPool.start([this, fileName]() { linkExtractionWorker(fileName); });
+}
+
+void Document::stopLinkExtraction()
+{
+    m_abortLinkExtraction = true;
+    m_linkExtractionPool.clear();
+    m_linkExtractionPool.waitForDone();
+}
+
+void Document::linkExtractionWorker(const QString &fileName)
+{
+    // one Poppler document is not safe to use from several threads, use an own one, sharing the mapping if any
+    // a worker that can't load the document leaves the pages to the others, it must not claim any
+    std::unique_ptr<QIODevice> device;
+    std::unique_ptr<Poppler::Document> document = loadPopplerDocument(fileName, m_mappedFile.get(), device);
+    if (!document || document->isLocked() || document->numPages() != numPages())
+        document.reset();
+
+    for (int i = document ? m_nextLinkExtractionPage++ : numPages(); i < numPages() && !m_abortLinkExtraction; i = m_nextLinkExtractionPage++) {
+        // nothing to do if links were extracted on demand or kept on reload and the fingerprint and size are known
+        bool needFingerprint = false;
+        const bool needSize = pageSizeProvisional(i);
+        {
+            QMutexLocker locker(&m_pageMutex);
+            needFingerprint = m_pageFingerprints[i].isEmpty();
+            if (m_linksExtracted[i] && !needFingerprint && !needSize)
+                continue;
+        }
+
+        // skip invalid pages, they get an empty size
+        std::vector<Link> links;
+        QByteArray fingerprint;
+        QSizeF size;
+        if (std::unique_ptr<Poppler::Page> page = document->page(i)) {
+            links = extractLinks(page.get());
+            if (needFingerprint)
+                fingerprint = fingerprintPage(page.get(), links);
+            size = page->pageSizeF();
+        }
+
+        // publish the links if not already extracted on demand
+        QMutexLocker locker(&m_pageMutex);
+        if (!m_linksExtracted[i]) {
+            m_links[i] = indexLinks(std::move(links));
+            m_linksExtracted[i] = true;
+            addNamedDestinationsLocked(m_links[i].links);
+        }
+        if (needFingerprint)
+            m_pageFingerprints[i] = fingerprint;
+        if (needSize)
+            m_measuredPageSizes[i] = size;
+    }
+
+    // last worker done => fix the layout, if all pages were handled remember links and sizes for the next open, needs an own document for the outline
+    // if no worker could load the document, the provisional sizes are measured on our document instead
+    if (--m_runningLinkExtractionWorkers == 0 && !m_abortLinkExtraction) {
+        if (document && m_nextLinkExtractionPage >= numPages())
+            storeCache(fileName, document.get());
+        if (!m_provisionalPageSizes.empty())
+            QMetaObject::invokeMethod(this, &Document::applyMeasuredPageSizes, Qt::QueuedConnection);
+    }
+}
+
+void Document::applyMeasuredPageSizes()
+{
+    // a newer document might be loading meanwhile, its last worker will trigger this again
+    if (m_provisionalPageSizes.empty() || m_runningLinkExtractionWorkers != 0 || m_abortLinkExtraction)
+        return;
+
+    // no worker could load the document => measure on our own, invalid pages get an empty size like in the workers
+    if (m_nextLinkExtractionPage < numPages()) {
+        QMutexLocker locker(&m_pageMutex);
+        for (int i = 0; i < numPages(); ++i) {
+            if (!m_provisionalPageSizes[i])
+                continue;
+
+            const std::unique_ptr<Poppler::Page> page = m_document->page(i);
+            m_measuredPageSizes[i] = page ? page->pageSizeF() : QSizeF();
+        }
+    }
+
+    QList<int> changedPages;
+    for (int i = 0; i < m_pageSizes.size(); ++i) {
+        if (m_measuredPageSizes.at(i) != m_pageSizes.at(i)) {
+            m_pageSizes[i] = m_measuredPageSizes.at(i);
+            changedPages << i;
+        }
+    }
+
+    m_provisionalPageSizes.clear();
+    m_measuredPageSizes.clear();
+
+    // usually all pages have the same size and nothing moves
+    if (changedPages.isEmpty())
+        return;
+
+    emit pageSizesChanged(changedPages);
+    relayout();
+}
+
+std::vector<Document::Link> Document::extractLinks(Poppler::Page *page)
+{
+    std::vector<Link> links;
+    for (const auto &annotation : page->annotations(QSet<Poppler::Annotation::SubType>() << Poppler::Annotation::ALink << Poppler::Annotation::AText << Poppler::Annotation::ACaret)) {
+        Link link;
+        link.boundary = annotation->boundary();
+
+        if (Poppler::Annotation::ALink == annotation->subType()) {
+            if (Poppler::Link *l = static_cast<Poppler::LinkAnnotation *>(annotation.get())->linkDestination()) {
+                switch (l->linkType()) {
+                    case Poppler::Link::Goto:
+                        link.type = Link::Goto;
+                        link.destination = static_cast<Poppler::LinkGoto *>(l)->destination().toString();
+                        link.destinationName = static_cast<Poppler::LinkGoto *>(l)->destination().destinationName();
+                        break;
+
+                    case Poppler::Link::Browse:
+                        link.type = Link::Browse;
+                        link.url = static_cast<Poppler::LinkBrowse *>(l)->url();
+                        break;
+
+                    default:
+                        break;
+                }
+            }
+        } else {
+            link.type = Link::Note;
+            link.contents = annotation->contents();
+        }
+
+        links.push_back(std::move(link));
+    }
+
+    return links;
+}
+
+QByteArray Document::fingerprintPage(Poppler::Page *page, const std::vector<Link> &links)
+{
+    // Poppler gives no access to the content streams, hash what they produce: the text with its layout, the links and a render for the rest
+    QByteArray content;
+    QDataStream stream(&content, QIODevice::WriteOnly);
+    stream << page->pageSizeF();
+    for (const std::unique_ptr<Poppler::TextBox> &box : page->textList())
+        stream << box->text() << box->boundingBox();
+    for (const Link &link : links)
+        stream << qint32(link.type) << link.boundary << link.destination << link.url << link.contents;
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(content);
+    const QImage image = page->renderToImage(FingerprintResolution, FingerprintResolution);
+    for (int y = 0; y < image.height(); ++y)
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(image.constScanLine(y)), image.width() * image.depth() / 8));
+    return hash.result();
+}
+
+Document::PageLinks Document::indexLinks(std::vector<Link> &&links)
+{
+    PageLinks pageLinks;
+    pageLinks.links = std::move(links);
+    if (pageLinks.links.size() < LinkGridMinLinks)
+        return pageLinks;
+
+    // add each link to all cells it overlaps, ascending as we go in document order
+    pageLinks.grid.resize(LinkGridSize * LinkGridSize);
+    for (int i = 0; i < int(pageLinks.links.size()); ++i) {
+        const QRectF &boundary = pageLinks.links.at(i).boundary;
+        const int left = qBound(0, int(boundary.left() * LinkGridSize), LinkGridSize - 1);
+        const int right = qBound(0, int(boundary.right() * LinkGridSize), LinkGridSize - 1);
+        const int top = qBound(0, int(boundary.top() * LinkGridSize), LinkGridSize - 1);
+        const int bottom = qBound(0, int(boundary.bottom() * LinkGridSize), LinkGridSize - 1);
+        for (int y = top; y <= bottom; ++y)
+            for (int x = left; x <= right; ++x)
+                pageLinks.grid[y * LinkGridSize + x].push_back(i);
+    }
+
+    return pageLinks;
+}
+
+void Document::addNamedDestinationsLocked(const std::vector<Link> &links) const
+{
+    // skip bogus destinations, Poppler is asked again for them
+    for (const Link &link : links)
+        if (link.type == Link::Goto && !link.destinationName.isEmpty() && Poppler::LinkDestination(link.destination).pageNumber() > 0)
+            m_namedDestinations.insert(link.destinationName, link.destination);
+}
+
+void Document::addNamedDestinationsLocked(const QVector<TocItem> &toc) const
+{
+    // bogus destinations are already empty
+    for (const TocItem &item : toc) {
+        if (!item.destinationName.isEmpty() && !item.destination.isEmpty())
+            m_namedDestinations.insert(item.destinationName, item.destination);
+        addNamedDestinationsLocked(item.children);
+    }
+}
+
+QVector<Document::TocItem> Document::tocFromOutline(const QVector<Poppler::OutlineItem> &outline)
+{
+    QVector<TocItem> toc;
+    for (const Poppler::OutlineItem &item : outline) {
+        TocItem tocItem;
+        tocItem.title = item.name();
+        tocItem.open = item.isOpen();
+
+        // skip bogus destinations
+        if (item.destination() && item.destination()->pageNumber() > 0) {
+            tocItem.destination = item.destination()->toString();
+            tocItem.destinationName = item.destination()->destinationName();
+        }
+
+        if (item.hasChildren())
+            tocItem.children = tocFromOutline(item.children());
+
+        toc << tocItem;
+    }
+
+    return toc;
+}
+
+void Document::storeCache(const QString &fileName, Poppler::Document *document) const
+{
+    DocumentCache::Data data;
+    data.pageSizes = m_provisionalPageSizes.empty() ? m_pageSizes : m_measuredPageSizes;
+    data.toc = tocFromOutline(document->outline());
+    {
+        QMutexLocker locker(&m_pageMutex);
+        for (const PageLinks &pageLinks : m_links)
+            data.links.push_back(pageLinks.links);
+        data.pageFingerprints = m_pageFingerprints;
+    }
+
+    DocumentCache::store(fileName, m_fingerprint, data);
 }
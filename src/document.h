@@ -20,17 +20,127 @@
 
 #pragma once
 
+#include "mappedfile.h"
+
 #include <poppler-qt6.h>
 
+#include <QHash>
+#include <QMutex>
 #include <QObject>
+#include <QPromise>
+#include <QThreadPool>
 
-class QProgressDialog;
+#include <atomic>
 
 class Document : public QObject
 {
     Q_OBJECT
 
+    // measures the layout and the page lookups in it
+    friend class DocumentLayoutBenchmark;
+
 public:
+    /**
+     * A link or note annotation on a page.
+     * Detached from the Poppler document it was extracted from, links are collected by background workers
+     * that each use their own Poppler document.
+     */
+    struct Link {
+        enum Type { Goto, Browse, Note, Other };
+
+        //! kind of link
+        Type type = Other;
+
+        //! area on the page, normalized to [0, 1]
+        QRectF boundary;
+
+        //! destination of Goto links, string representation parsable by the LinkDestination constructor
+        QString destination;
+
+        //! name of the destination of Goto links if it is a named one
+        QString destinationName;
+
+        //! url of Browse links
+        QString url;
+
+        //! text of notes
+        QString contents;
+    };
+
+    /**
+     * An entry of the table of contents.
+     * Detached from Poppler, the table of contents is cached between sessions.
+     */
+    struct TocItem {
+        //! title to show
+        QString title;
+
+        //! destination, string representation parsable by the LinkDestination constructor, empty if none
+        QString destination;
+
+        //! name of the destination if it is a named one
+        QString destinationName;
+
+        //! shall the entry be expanded initially?
+        bool open = false;
+
+        //! sub entries
+        QVector<TocItem> children;
+    };
+
+    /**
+     * Links of one page together with a uniform grid over the page for fast hit testing.
+     */
+    struct PageLinks {
+        //! the links in document order
+        std::vector<Link> links;
+
+        //! LinkGridSize x LinkGridSize cells holding the ascending indices of the links overlapping them, empty for pages with few links
+        std::vector<std::vector<int>> grid;
+    };
+
+    /**
+     * A document loaded and prepared in the background via prepare(), to be set via setDocument().
+     * Allows to keep the old document alive until the new one is ready.
+     */
+    struct Prepared {
+        //! mapping it was loaded from, if any, declared first to be destroyed after the device and the document
+        std::shared_ptr<MappedFile> mappedFile;
+
+        //! device of the mapping the document reads from, if any
+        std::unique_ptr<QIODevice> device;
+
+        //! the loaded poppler document
+        std::unique_ptr<Poppler::Document> document;
+
+        //! file it was loaded from
+        QString fileName;
+
+        //! fingerprint of the file, see DocumentCache
+        QByteArray fingerprint;
+
+        //! page sizes in points, index == page
+        QVector<QSizeF> pageSizes;
+
+        //! pages with a guessed size, corrected by the background workers after setDocument(), index == page, empty if all sizes are exact
+        std::vector<bool> provisionalPageSizes;
+
+        //! links and table of contents are valid, taken from the cache
+        bool fromCache = false;
+
+        //! links on the pages if taken from the cache, index == page
+        std::vector<PageLinks> links;
+
+        //! table of contents if taken from the cache
+        QVector<TocItem> toc;
+
+        //! content fingerprints of the pages if taken from the cache or computed for a reload, index == page, else empty
+        std::vector<QByteArray> pageFingerprints;
+
+        //! destinations resolved by name before, see resolveDestination(), if taken back via takeDocument()
+        QHash<QString, QString> namedDestinations;
+    };
+
     Document();
     ~Document();
 
@@ -40,8 +150,41 @@ public:
         return m_document.get();
     }
 
-    /*! Set Poppler document to use, any old data will be deleted. */
-    void setDocument(std::unique_ptr<Poppler::Document> &&document, QProgressDialog *pd = nullptr);
+    /*! Load a Poppler document, from the mapped file if one is given, else from the file. Can be called from any thread.
+        The device is set if the document reads from the mapping, it must be destroyed after the document. */
+    static std::unique_ptr<Poppler::Document> loadPopplerDocument(const QString &fileName, MappedFile *mappedFile, std::unique_ptr<QIODevice> &device);
+
+    /*! Load and prepare the given file for setDocument(), the result is nullptr on failure. To be run via QtConcurrent::run().
+        Only collects page sizes or takes all from the cache if the file is unchanged.
+        For large documents only the first and the target page are measured, the others get provisional sizes to show the target page fast.
+        For reloads, fingerprintPages computes the content fingerprints of all pages to find the unchanged ones.
+        Reports the progress of the stages and stops without result as soon as the future is canceled. */
+    static void prepare(QPromise<std::unique_ptr<Prepared>> &promise, const QString &fileName, std::shared_ptr<MappedFile> mappedFile, bool fingerprintPages, int targetPage);
+
+    /*! Load the Poppler document again for data taken via takeDocument(), the result is nullptr if the file changed meanwhile or can't be loaded.
+        To be run via QtConcurrent::run(), stops without result as soon as the future is canceled. */
+    static void restore(QPromise<std::unique_ptr<Prepared>> &promise, std::unique_ptr<Prepared> prepared, std::shared_ptr<MappedFile> mappedFile);
+
+    /*! Set prepared document to use, any old data will be deleted, nullptr only resets. Links are extracted in the background if not cached.
+        If the document was loaded from a mapped file, the mapping is kept alive as long as the document.
+        If the prepared document has page fingerprints, links of pages unchanged compared to the old document are kept. */
+    void setDocument(std::unique_ptr<Prepared> prepared);
+
+    /*! Take the document out to keep it for a later setDocument() or restore(), e.g. while another document is shown, leaves the object reset like setDocument(nullptr).
+        Links and table of contents go along if complete, else they are extracted again. The file name is left empty. Returns nullptr if there is no document. */
+    std::unique_ptr<Prepared> takeDocument();
+
+    /*! Returns true if the document is memory mapped and the file was truncated, the document must not be used anymore then. */
+    bool mappedFileTruncated() const
+    {
+        return m_mappedFile && m_mappedFile->isTruncated();
+    }
+
+    /*! Returns the fingerprint of the file the document was loaded from, see DocumentCache, empty if unknown. */
+    QByteArray fingerprint() const
+    {
+        return m_fingerprint;
+    }
 
     /*! Returns document title */
     QString title() const
@@ -50,7 +193,7 @@ public:
     }
 
     /*! Returns the table of contents. */
-    QVector<Poppler::OutlineItem> toc() const;
+    QVector<TocItem> toc() const;
 
     /*! Returns the required size of a viewport. */
     QSizeF layoutSize() const
@@ -61,7 +204,20 @@ public:
     /*! Returns the number of available pages. */
     int numPages() const
     {
-        return m_pages.size();
+        return m_pageSizes.size();
+    }
+
+    /*! Returns the size of the given page in points. */
+    QSizeF pageSize(int page) const
+    {
+        Q_ASSERT(page >= 0 && page < m_pageSizes.size());
+        return m_pageSizes.at(page);
+    }
+
+    /*! Returns true if the size of the given page is a guess, corrected once the background workers measured all pages, see pageSizesChanged(). */
+    bool pageSizeProvisional(int page) const
+    {
+        return page >= 0 && size_t(page) < m_provisionalPageSizes.size() && m_provisionalPageSizes[page];
     }
 
     /*! Returns page numbers visible in given rectangle. */
@@ -76,14 +232,34 @@ public:
     /*! Returns the page that occupies most of the space in the given rectangle.*/
     int pageForRect(const QRectF &rect) const;
 
-    /*! Returns a Poppler page for the given page number or nullptr. */
+    /*! Returns true if the given page has the same content as the page with the same number in the document before the last setDocument(),
+        always false if that was no reload with page fingerprints. Allows to keep links, search matches and renders of the page. */
+    bool pageUnchanged(int page) const
+    {
+        return page >= 0 && size_t(page) < m_unchangedPages.size() && m_unchangedPages[page];
+    }
+
+    /*! Returns true if the last setDocument() was a reload that kept any unchanged page. */
+    bool keptUnchangedPages() const;
+
+    /*! Returns the Poppler render hints used for the pages, 0 without document. */
+    int renderHints() const
+    {
+        return m_document ? m_document->renderHints().toInt() : 0;
+    }
+
+    /*! Returns a Poppler page for the given page number or nullptr, the page is created on first use. */
     Poppler::Page *page(int page) const;
 
-    /*! Returns a list of links found on the given page number. */
-    const std::vector<std::unique_ptr<Poppler::Annotation>> &links(int page) const;
+    /*! Returns a list of links found on the given page number, extracted on demand if the background workers are not done with it. */
+    const std::vector<Link> &links(int page) const;
 
-    /*! Returns a link destination for the given name or nullptr. */
-    std::unique_ptr<Poppler::LinkDestination> linkDestination(const QString &destination) const;
+    /*! Returns the first link on the given page containing the point (normalized to [0, 1]) or nullptr. */
+    const Link *linkAt(int page, const QPointF &point) const;
+
+    /*! Returns the destination with the given name, string representation parsable by the LinkDestination constructor, empty if unknown or bogus.
+        Names used by links and the table of contents are known without asking Poppler, other ones are remembered after the first lookup. */
+    QString resolveDestination(const QString &name) const;
 
     /**
      * double sided mode on?
@@ -104,14 +280,70 @@ private:
     /*! Perform a relayout of the current document. */
     void relayout();
 
+    /*! Returns the index of the first row that ends at or below the given y coordinate, m_rows.size() if none. */
+    int firstRowBelow(qreal y) const;
+
     /*! Free memory used. */
     void reset();
 
+    /*! Returns the Poppler page for the given page number, creating it if needed, m_pageMutex must be locked. */
+    Poppler::Page *pageLocked(int page) const;
+
+    /*! Start the background extraction of all links, using own Poppler documents for the given file or mapping. */
+    void startLinkExtraction(const QString &fileName);
+
+    /*! Abort the background extraction of links and wait for the workers. */
+    void stopLinkExtraction();
+
+    /*! Background worker: extract links and fingerprints of not yet handled pages until all are done. */
+    void linkExtractionWorker(const QString &fileName);
+
+    /*! Extract the links of the given Poppler page. */
+    static std::vector<Link> extractLinks(Poppler::Page *page);
+
+    /*! Compute the content fingerprint of the given Poppler page with the given links: its text with the layout, the links and an antialiased render. */
+    static QByteArray fingerprintPage(Poppler::Page *page, const std::vector<Link> &links);
+
+    /*! Remember the named destinations of the given links, m_pageMutex must be locked. */
+    void addNamedDestinationsLocked(const std::vector<Link> &links) const;
+
+    /*! Remember the named destinations of the given table of contents, m_pageMutex must be locked. */
+    void addNamedDestinationsLocked(const QVector<TocItem> &toc) const;
+
+    /*! Build the hit testing grid for the given links. */
+    static PageLinks indexLinks(std::vector<Link> &&links);
+
+    /*! Returns the links of the given page, extracting them on demand. */
+    const PageLinks &pageLinks(int page) const;
+
+    /*! Convert the Poppler outline to our table of contents. */
+    static QVector<TocItem> tocFromOutline(const QVector<Poppler::OutlineItem> &outline);
+
+    /*! Replace the provisional page sizes with the ones measured by the background workers, all must be done. Measures on our document if none could load it. */
+    void applyMeasuredPageSizes();
+
+    /*! Store page sizes, links and table of contents in the on-disk cache, all links must be extracted. */
+    void storeCache(const QString &fileName, Poppler::Document *document) const;
+
 signals:
     void documentChanged();
     void layoutChanged();
 
+    /*! Provisional sizes of the given pages were wrong, emitted before the relayout. */
+    void pageSizesChanged(const QList<int> &pages);
+
 private:
+    /**
+     * memory mapping the document was loaded from, if any
+     * must be destroyed after the Poppler documents and devices that use it
+     */
+    std::shared_ptr<MappedFile> m_mappedFile;
+
+    /**
+     * device of the mapping the document reads from, if any, must be destroyed after the document
+     */
+    std::unique_ptr<QIODevice> m_device;
+
     /**
      * current open poppler document
      */
@@ -122,6 +354,17 @@ private:
      */
     QString m_title;
 
+    /**
+     * fingerprint of the file the document was loaded from, see DocumentCache
+     */
+    QByteArray m_fingerprint;
+
+    /**
+     * table of contents, computed on first request or loaded from the cache
+     */
+    mutable QVector<TocItem> m_toc;
+    mutable bool m_tocLoaded = false;
+
     /**
      * double sided layout?
      */
@@ -132,15 +375,96 @@ private:
      */
     QVector<QRectF> m_pageRects;
 
+    /**
+     * A row of pages in the layout: one page or two in double sided mode.
+     */
+    struct Row {
+        qreal top = 0;
+        qreal bottom = 0;
+        int firstPage = 0;
+        int lastPage = 0;
+    };
+
+    /**
+     * rows of the layout sorted from top to bottom, allows binary search for the pages in some area
+     */
+    QVector<Row> m_rows;
+
+    /**
+     * vector of page sizes in points, index == page
+     * filled eagerly on document change, enough for relayout()
+     */
+    QVector<QSizeF> m_pageSizes;
+
+    /**
+     * destinations by name, string representation parsable by the LinkDestination constructor, empty for unknown names
+     * filled from the links, the table of contents and on lookup, avoids walking the name tree of the document
+     */
+    mutable QHash<QString, QString> m_namedDestinations;
+
+    /**
+     * pages with a guessed size, index == page, empty if all sizes are exact
+     * only changed while no background workers run
+     */
+    std::vector<bool> m_provisionalPageSizes;
+
+    /**
+     * sizes of the pages measured by the background workers if some were guessed, index == page
+     */
+    QVector<QSizeF> m_measuredPageSizes;
+
+    /**
+     * guards the lazy creation of pages and links, pages are requested by background renderers, too
+     */
+    mutable QMutex m_pageMutex;
+
     /**
      * vector of cached poppler pages, index == page
+     * created on first request via page()
+     */
+    mutable std::vector<std::unique_ptr<Poppler::Page>> m_pages;
+
+    /**
+     * vector of links on the pages, index == page
+     * filled by the background workers or on demand via links()
+     */
+    mutable std::vector<PageLinks> m_links;
+
+    /**
+     * did we already extract the links for the page? index == page
+     */
+    mutable std::vector<bool> m_linksExtracted;
+
+    /**
+     * content fingerprints of the pages, index == page, empty if not yet computed
+     * filled by the background workers or taken from the cache, compared on reload
+     */
+    std::vector<QByteArray> m_pageFingerprints;
+
+    /**
+     * pages with the same content as before the last reload, index == page
+     */
+    std::vector<bool> m_unchangedPages;
+
+    /**
+     * thread pool for the link extraction workers, renders and loading have own ones, too
+     */
+    QThreadPool m_linkExtractionPool;
+
+    /**
+     * next page a link extraction worker shall handle
+     */
+    std::atomic<int> m_nextLinkExtractionPage = 0;
+
+    /**
+     * set to abort the link extraction workers
      */
-    std::vector<std::unique_ptr<Poppler::Page>> m_pages;
+    std::atomic<bool> m_abortLinkExtraction = false;
 
     /**
-     * vector of cached poppler annotation of type link, index == page
+     * number of link extraction workers not yet done, the last one stores the cache
      */
-    std::vector<std::vector<std::unique_ptr<Poppler::Annotation>>> m_links;
+    std::atomic<int> m_runningLinkExtractionWorkers = 0;
 
     /**
      * spacing between pages and the margin around the document
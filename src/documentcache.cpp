@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * includes
+ */
+
+#include "documentcache.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+/*
+ * defines
+ */
+
+#define CacheMagic quint32(0x46414443)
+#define CacheVersion quint32(4)
+
+// amount of bytes hashed at the start and the end of the file
+#define ContentHashChunkSize 65536
+
+// minimal bytes of the serialized records, counts in the file are checked against them before allocating
+#define MinPageRecordSize (16 + 4 + 4)
+#define MinLinkRecordSize (4 + 32 + 4 * 4)
+#define MinTocItemRecordSize (3 * 4 + 1 + 4)
+
+// deepest nesting of the table of contents we read, guards the recursion
+#define MaxTocDepth 64
+
+/*
+ * helpers
+ */
+
+static QString cacheFileName(const QString &fileName)
+{
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/documents");
+    return cacheDir + QStringLiteral("/") + QString::fromLatin1(QCryptographicHash::hash(fileName.toUtf8(), QCryptographicHash::Sha1).toHex()) + QStringLiteral(".cache");
+}
+
+static void writeToc(QDataStream &stream, const QVector<Document::TocItem> &toc)
+{
+    stream << qint32(toc.size());
+    for (const Document::TocItem &item : toc) {
+        stream << item.title << item.destination << item.destinationName << item.open;
+        writeToc(stream, item.children);
+    }
+}
+
+// a corrupt count must not make us allocate more records than the rest of the file can hold
+static bool countFits(QDataStream &stream, qint32 count, qint64 minRecordSize)
+{
+    return count >= 0 && stream.status() == QDataStream::Ok && qint64(count) * minRecordSize <= stream.device()->bytesAvailable();
+}
+
+static bool readToc(QDataStream &stream, QVector<Document::TocItem> &toc, int depth = 0)
+{
+    qint32 count = 0;
+    stream >> count;
+    if (depth > MaxTocDepth || !countFits(stream, count, MinTocItemRecordSize))
+        return false;
+
+    toc.resize(count);
+    for (Document::TocItem &item : toc) {
+        stream >> item.title >> item.destination >> item.destinationName >> item.open;
+        if (!readToc(stream, item.children, depth + 1))
+            return false;
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+/*
+ * public methods
+ */
+
+QByteArray DocumentCache::fingerprint(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    // hash head and tail of the file, the tail holds the trailer with the document id and the xref offset
+    // that change on any rewrite, hashing all content would cost as much as a cold open
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(file.read(ContentHashChunkSize));
+    if (file.size() > ContentHashChunkSize) {
+        file.seek(qMax(qint64(ContentHashChunkSize), file.size() - ContentHashChunkSize));
+        hash.addData(file.read(ContentHashChunkSize));
+    }
+
+    QByteArray fingerprint;
+    QDataStream stream(&fingerprint, QIODevice::WriteOnly);
+    stream << fileName << file.size() << QFileInfo(file).lastModified().toMSecsSinceEpoch() << hash.result();
+    return fingerprint;
+}
+
+bool DocumentCache::load(const QString &fileName, const QByteArray &fingerprint, Data &data)
+{
+    if (fingerprint.isEmpty())
+        return false;
+
+    QFile file(cacheFileName(fileName));
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    // check header, wrong version or changed file => ignore the cache
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray cachedFingerprint;
+    stream >> magic >> version >> cachedFingerprint;
+    if (magic != CacheMagic || version != CacheVersion || cachedFingerprint != fingerprint)
+        return false;
+
+    qint32 pageCount = 0;
+    stream >> pageCount;
+    if (!countFits(stream, pageCount, MinPageRecordSize))
+        return false;
+
+    Data cached;
+    cached.pageSizes.resize(pageCount);
+    cached.links.resize(pageCount);
+    cached.pageFingerprints.resize(pageCount);
+    for (int i = 0; i < pageCount; ++i) {
+        qint32 linkCount = 0;
+        stream >> cached.pageSizes[i] >> cached.pageFingerprints[i] >> linkCount;
+        if (!countFits(stream, linkCount, MinLinkRecordSize))
+            return false;
+
+        cached.links[i].resize(linkCount);
+        for (Document::Link &link : cached.links[i]) {
+            qint32 type = 0;
+            stream >> type >> link.boundary >> link.destination >> link.destinationName >> link.url >> link.contents;
+            if (type < Document::Link::Goto || type > Document::Link::Other)
+                return false;
+            link.type = Document::Link::Type(type);
+        }
+    }
+
+    if (!readToc(stream, cached.toc))
+        return false;
+
+    data = std::move(cached);
+    return true;
+}
+
+void DocumentCache::store(const QString &fileName, const QByteArray &fingerprint, const Data &data)
+{
+    if (fingerprint.isEmpty())
+        return;
+
+    const QString cacheFile = cacheFileName(fileName);
+    QDir().mkpath(QFileInfo(cacheFile).absolutePath());
+
+    // write atomically, another instance might read the cache
+    QSaveFile file(cacheFile);
+    if (!file.open(QSaveFile::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    stream << CacheMagic << CacheVersion << fingerprint;
+
+    stream << qint32(data.pageSizes.size());
+    for (int i = 0; i < data.pageSizes.size(); ++i) {
+        stream << data.pageSizes.at(i) << data.pageFingerprints.at(i) << qint32(data.links.at(i).size());
+        for (const Document::Link &link : data.links.at(i))
+            stream << qint32(link.type) << link.boundary << link.destination << link.destinationName << link.url << link.contents;
+    }
+
+    writeToc(stream, data.toc);
+
+    if (stream.status() == QDataStream::Ok)
+        file.commit();
+}
+
+void DocumentCache::remove(const QString &fileName)
+{
+    QFile::remove(cacheFileName(fileName));
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "document.h"
+
+#include <QByteArray>
+#include <QSizeF>
+#include <QString>
+#include <QVector>
+
+/**
+ * On-disk cache for the per document data that is costly to compute on open.
+ * One versioned binary file per document in the cache location, keyed by the document path
+ * and validated against the fingerprint of the file.
+ */
+class DocumentCache
+{
+public:
+    /**
+     * Cached data of one document.
+     */
+    struct Data {
+        //! page sizes in points, index == page, all that relayout() needs
+        QVector<QSizeF> pageSizes;
+
+        //! links on the pages, index == page
+        std::vector<std::vector<Document::Link>> links;
+
+        //! content fingerprints of the pages, index == page, see Document::fingerprintPage()
+        std::vector<QByteArray> pageFingerprints;
+
+        //! table of contents
+        QVector<Document::TocItem> toc;
+    };
+
+    /**
+     * Compute the fingerprint of the given file: size, modification time and a content hash.
+     * @param fileName file to fingerprint
+     * @return fingerprint, empty if the file can't be read
+     */
+    static QByteArray fingerprint(const QString &fileName);
+
+    /**
+     * Load the cached data for the given file.
+     * @param fileName file the data belongs to
+     * @param fingerprint fingerprint of the file, the cache is ignored if it doesn't match
+     * @param data data to fill
+     * @return success?
+     */
+    static bool load(const QString &fileName, const QByteArray &fingerprint, Data &data);
+
+    /**
+     * Store the data for the given file, replacing the old one.
+     * @param fileName file the data belongs to
+     * @param fingerprint fingerprint of the file at the moment the data was computed
+     * @param data data to store
+     */
+    static void store(const QString &fileName, const QByteArray &fingerprint, const Data &data);
+
+    /**
+     * Remove the cached data for the given file.
+     * @param fileName file the data belongs to
+     */
+    static void remove(const QString &fileName);
+};
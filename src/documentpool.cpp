@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * includes
+ */
+
+#include "documentpool.h"
+
+#include <QSettings>
+
+/*
+ * defines
+ */
+
+// default budget in megabytes
+#define DefaultResidentDocumentsSize 512
+
+/*
+ * helpers
+ */
+
+static qint64 stringSize(const QString &string)
+{
+    return qint64(sizeof(QString)) + string.size() * qint64(sizeof(QChar));
+}
+
+static qint64 tocSize(const QVector<Document::TocItem> &toc)
+{
+    qint64 size = 0;
+    for (const Document::TocItem &item : toc)
+        size += qint64(sizeof(Document::TocItem)) + stringSize(item.title) + stringSize(item.destination) + stringSize(item.destinationName) + tocSize(item.children);
+    return size;
+}
+
+static qint64 preparedSize(const Document::Prepared &prepared)
+{
+    // estimate, counts the payload and the direct overhead of the containers, not the allocator
+    qint64 size = qint64(sizeof(Document::Prepared)) + stringSize(prepared.fileName) + prepared.fingerprint.size();
+    size += prepared.pageSizes.size() * qint64(sizeof(QSizeF)) + qint64(prepared.provisionalPageSizes.size()) / 8;
+    for (const Document::PageLinks &pageLinks : prepared.links) {
+        size += qint64(sizeof(Document::PageLinks));
+        for (const Document::Link &link : pageLinks.links)
+            size += qint64(sizeof(Document::Link)) + stringSize(link.destination) + stringSize(link.destinationName) + stringSize(link.url) + stringSize(link.contents);
+        for (const std::vector<int> &cell : pageLinks.grid)
+            size += qint64(sizeof(cell)) + qint64(cell.size() * sizeof(int));
+    }
+    size += tocSize(prepared.toc);
+    for (const QByteArray &fingerprint : prepared.pageFingerprints)
+        size += qint64(sizeof(QByteArray)) + fingerprint.size();
+    for (auto it = prepared.namedDestinations.cbegin(); it != prepared.namedDestinations.cend(); ++it)
+        size += stringSize(it.key()) + stringSize(it.value());
+    return size;
+}
+
+/*
+ * public methods
+ */
+
+DocumentPool::DocumentPool()
+    : m_budget(qint64(qMax(0, QSettings().value(QStringLiteral("Document/residentDocumentsSize"), DefaultResidentDocumentsSize).toInt())) * 1024 * 1024)
+{
+}
+
+void DocumentPool::insert(const QString &fileName, std::unique_ptr<Document::Prepared> prepared, PageView::Renders &&renders)
+{
+    if (!isEnabled() || !prepared)
+        return;
+
+    // a document shown twice is resident once
+    for (auto it = m_items.begin(); it != m_items.end(); ++it) {
+        if (it->entry.prepared->fileName == fileName) {
+            m_size -= it->size;
+            m_items.erase(it);
+            break;
+        }
+    }
+
+    // no open Poppler document and file handle for a file no longer shown, loading it again is cheap compared to measuring and rendering
+    prepared->document.reset();
+    prepared->device.reset();
+    prepared->mappedFile.reset();
+    prepared->fileName = fileName;
+
+    // the renders use most memory, but page sizes, links and table of contents of a large manual count, too, else entries without renders are never dropped
+    const qint64 size = renders.size() + preparedSize(*prepared);
+    m_items.push_front(Item{Entry{std::move(prepared), std::move(renders)}, size});
+    m_size += size;
+
+    while (m_size > m_budget && !m_items.empty()) {
+        m_size -= m_items.back().size;
+        m_items.pop_back();
+    }
+}
+
+std::optional<DocumentPool::Entry> DocumentPool::take(const QString &fileName)
+{
+    for (auto it = m_items.begin(); it != m_items.end(); ++it) {
+        if (it->entry.prepared->fileName != fileName)
+            continue;
+
+        Entry entry = std::move(it->entry);
+        m_size -= it->size;
+        m_items.erase(it);
+        return entry;
+    }
+
+    return std::nullopt;
+}
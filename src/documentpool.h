@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "document.h"
+#include "pageview.h"
+
+#include <QString>
+
+#include <list>
+#include <memory>
+#include <optional>
+
+/**
+ * Keeps the data of the documents shown before resident, together with their renders and link index, a product ships several manuals
+ * and the user switches between them. Switching back to a resident document needs no measuring, no link extraction and no renders,
+ * only the Poppler document is loaded again via Document::restore(), that also checks that the file is unchanged.
+ * Resident documents keep no Poppler document and no file open, the files can be replaced meanwhile.
+ * The renders and data of all resident documents are limited via Document/residentDocumentsSize in megabytes, 0 disables the pool,
+ * the least recently shown documents are dropped first. Only used by the GUI thread.
+ */
+class DocumentPool
+{
+public:
+    /**
+     * A resident document.
+     */
+    struct Entry {
+        //! document as taken via Document::takeDocument(), file name set, without Poppler document and mapping
+        std::unique_ptr<Document::Prepared> prepared;
+
+        //! renders as taken via PageView::takeRenders()
+        PageView::Renders renders;
+    };
+
+    /**
+     * Construct an empty pool with the configured budget.
+     */
+    DocumentPool();
+
+    /**
+     * Is the pool enabled?
+     * @return enabled?
+     */
+    bool isEnabled() const
+    {
+        return m_budget > 0;
+    }
+
+    /**
+     * Keep a document resident, drops the least recently shown ones if the budget is exceeded, maybe the new one itself.
+     * @param fileName file the document was loaded from
+     * @param prepared document to keep, nothing happens for nullptr
+     * @param renders renders of the document
+     */
+    void insert(const QString &fileName, std::unique_ptr<Document::Prepared> prepared, PageView::Renders &&renders);
+
+    /**
+     * Take a resident document out of the pool.
+     * @param fileName file to get the document for
+     * @return document or nothing if not resident
+     */
+    std::optional<Entry> take(const QString &fileName);
+
+private:
+    /**
+     * A resident document with its accounted bytes.
+     */
+    struct Item {
+        Entry entry;
+        qint64 size = 0;
+    };
+
+    /**
+     * resident documents, most recently shown first
+     */
+    std::list<Item> m_items;
+
+    /**
+     * maximal bytes to use
+     */
+    qint64 m_budget = 0;
+
+    /**
+     * bytes used
+     */
+    qint64 m_size = 0;
+};
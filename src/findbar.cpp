@@ -129,8 +129,11 @@ FindBar::~FindBar()
 
 void FindBar::slotDocumentChanged()
 {
-    slotHide();
-    m_findEdit->clear();
+    // a reload keeping unchanged pages keeps the search, the search engine updates the matches
+    if (!PdfViewer::document()->keptUnchangedPages()) {
+        slotHide();
+        m_findEdit->clear();
+    }
 
     bool on = PdfViewer::document()->isValid();
     m_findEdit->setEnabled(on);
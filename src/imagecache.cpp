@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "imagecache.h"
+
+#include <QDataStream>
+#include <QSettings>
+
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// default budget in megabytes
+#define DefaultImageCacheSize 256
+
+// lower bound of the adaptive budget in megabytes, enough for the visible pages at usual zoom levels
+#define MinimumAdaptiveImageCacheSize 32
+
+// default budget of the compressed tier in megabytes
+#define DefaultCompressedImageCacheSize 64
+
+// zlib level for the compressed tier, speed matters more than size
+#define CompressionLevel 1
+
+/*
+ * helpers
+ */
+
+static bool isOpaqueGray(const QImage &image)
+{
+    // rendered pages are 32 bit, the usual black text on white fits into 8 bit without loss
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32 && image.format() != QImage::Format_ARGB32_Premultiplied)
+        return false;
+
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            const QRgb pixel = line[x];
+            if (qAlpha(pixel) != 255 || qRed(pixel) != qGreen(pixel) || qGreen(pixel) != qBlue(pixel))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static qint64 availableMemory()
+{
+#if defined(Q_OS_WIN)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? qint64(status.ullAvailPhys) : 0;
+#elif defined(_SC_AVPHYS_PAGES)
+    return qint64(sysconf(_SC_AVPHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+#else
+    // no portable way to get the free memory, e.g. on macOS, use the physical one
+    return qint64(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/*
+ * public methods
+ */
+
+ImageCache::ImageCache(qint64 budget, qint64 compressedBudget)
+    : m_compressedBudget(compressedBudget)
+    , m_budget(budget)
+{
+}
+
+qint64 ImageCache::configuredBudget()
+{
+    QSettings settings;
+    const qint64 budget = qint64(qMax(1, settings.value(QStringLiteral("PageView/imageCacheSize"), DefaultImageCacheSize).toInt())) * 1024 * 1024;
+    if (!settings.value(QStringLiteral("PageView/imageCacheAdaptive"), false).toBool())
+        return budget;
+
+    // follow the free memory in both directions, the configured size is the upper bound
+    return qBound(qMin(budget, qint64(MinimumAdaptiveImageCacheSize) * 1024 * 1024), availableMemory() / 4, budget);
+}
+
+qint64 ImageCache::configuredCompressedBudget()
+{
+    return qint64(qMax(0, QSettings().value(QStringLiteral("PageView/compressedImageCacheSize"), DefaultCompressedImageCacheSize).toInt())) * 1024 * 1024;
+}
+
+void ImageCache::setBudget(qint64 budget)
+{
+    m_budget = budget;
+    trim(m_budget);
+}
+
+QImage ImageCache::object(const Key &key)
+{
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        ++m_statistics.hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->lru);
+        return it->image;
+    }
+
+    auto compressedIt = m_compressedEntries.find(key);
+    if (compressedIt == m_compressedEntries.end()) {
+        ++m_statistics.misses;
+        return QImage();
+    }
+
+    // move it back to the uncompressed ones
+    const QImage image = uncompressImage(compressedIt->data);
+    if (image.isNull()) {
+        ++m_statistics.misses;
+        removeCompressed(key);
+        return QImage();
+    }
+
+    ++m_statistics.hits;
+    ++m_statistics.compressedHits;
+
+    // too large for the uncompressed ones => stays compressed, as recently used
+    if (image.sizeInBytes() > m_budget) {
+        m_compressedLru.splice(m_compressedLru.begin(), m_compressedLru, compressedIt->lru);
+        return image;
+    }
+
+    insert(key, image);
+    return image;
+}
+
+bool ImageCache::insert(const Key &key, const QImage &image)
+{
+    remove(key);
+
+    const qint64 cost = image.sizeInBytes();
+    if (cost > m_budget)
+        return false;
+
+    // make room, then add as most recently used
+    trim(m_budget - cost);
+    m_lru.push_front(key);
+    m_entries.insert(key, Entry{image, m_lru.begin()});
+    m_size += cost;
+    return true;
+}
+
+QByteArray ImageCache::compressImage(const QImage &image)
+{
+    // gray pages need only a quarter of the bytes before compression
+    const bool grayscale = isOpaqueGray(image);
+    const QImage pixels = grayscale ? image.convertToFormat(QImage::Format_Grayscale8) : image;
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << qint32(image.format()) << image.size() << image.devicePixelRatio() << grayscale
+           << qCompress(pixels.constBits(), int(pixels.sizeInBytes()), CompressionLevel);
+    return data;
+}
+
+QImage ImageCache::uncompressImage(const QByteArray &data)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    qint32 format = 0;
+    QSize size;
+    qreal devicePixelRatio = 1.0;
+    bool grayscale = false;
+    QByteArray pixels;
+    stream >> format >> size >> devicePixelRatio >> grayscale >> pixels;
+    if (stream.status() != QDataStream::Ok || format <= QImage::Format_Invalid || format >= QImage::NImageFormats || size.isEmpty())
+        return QImage();
+
+    // decompress into an image of the same layout
+    QImage image(size, grayscale ? QImage::Format_Grayscale8 : QImage::Format(format));
+    pixels = qUncompress(pixels);
+    if (image.isNull() || pixels.size() != image.sizeInBytes())
+        return QImage();
+
+    std::memcpy(image.bits(), pixels.constData(), pixels.size());
+    if (grayscale)
+        image = image.convertToFormat(QImage::Format(format));
+    image.setDevicePixelRatio(devicePixelRatio);
+    return image;
+}
+
+void ImageCache::remove(const Key &key)
+{
+    removeCompressed(key);
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return;
+
+    m_size -= it->image.sizeInBytes();
+    m_lru.erase(it->lru);
+    m_entries.erase(it);
+}
+
+void ImageCache::clear()
+{
+    m_entries.clear();
+    m_lru.clear();
+    m_size = 0;
+
+    m_compressedEntries.clear();
+    m_compressedLru.clear();
+    m_compressedSize = 0;
+}
+
+/*
+ * private methods
+ */
+
+void ImageCache::trim(qint64 budget)
+{
+    while (m_size > budget && !m_lru.empty()) {
+        const Key key = m_lru.back();
+        const QImage image = m_entries.value(key).image;
+        remove(key);
+        ++m_statistics.evictions;
+        insertCompressed(key, image);
+    }
+}
+
+void ImageCache::insertCompressed(const Key &key, const QImage &image)
+{
+    if (m_compressedBudget <= 0)
+        return;
+
+    CompressedEntry entry;
+    entry.data = compressImage(image);
+
+    const qint64 cost = entry.data.size();
+    if (cost > m_compressedBudget)
+        return;
+
+    // make room, then add as most recently used
+    while (m_compressedSize + cost > m_compressedBudget && !m_compressedLru.empty()) {
+        const Key oldKey = m_compressedLru.back();
+        removeCompressed(oldKey);
+    }
+
+    m_compressedLru.push_front(key);
+    entry.lru = m_compressedLru.begin();
+    m_compressedEntries.insert(key, entry);
+    m_compressedSize += cost;
+}
+
+void ImageCache::removeCompressed(const Key &key)
+{
+    auto it = m_compressedEntries.find(key);
+    if (it == m_compressedEntries.end())
+        return;
+
+    m_compressedSize -= it->data.size();
+    m_compressedLru.erase(it->lru);
+    m_compressedEntries.erase(it);
+}
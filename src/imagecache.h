@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QHashFunctions>
+#include <QImage>
+#include <QList>
+
+#include <list>
+
+/**
+ * Cache for rendered page images, limited by the bytes the images use, not by their count.
+ * A page rendered at high zoom on a HiDPI screen can need more than hundred megabytes, a thumbnail only some kilobytes.
+ * Least recently used images are evicted first. Not thread-safe, users must lock it.
+ * Evicted images move to a second tier with an own budget that holds them losslessly compressed,
+ * rendered pages are mostly black text on white and shrink a lot, decompressing is far faster than rendering again.
+ */
+class ImageCache
+{
+public:
+    /**
+     * Identifies a rendered tile of a page, small pages are rendered as one tile 0/0.
+     */
+    struct Key {
+        //! page number
+        int page = 0;
+
+        //! resolution the tile was rendered with, without the device pixel ratio
+        qreal resolution = 72.0;
+
+        //! device pixel ratio the tile was rendered with
+        qreal devicePixelRatio = 1.0;
+
+        //! Poppler render hints the tile was rendered with
+        int renderHints = 0;
+
+        //! column of the tile
+        int tileX = 0;
+
+        //! row of the tile
+        int tileY = 0;
+
+        bool operator==(const Key &other) const
+        {
+            return page == other.page && resolution == other.resolution && devicePixelRatio == other.devicePixelRatio && renderHints == other.renderHints && tileX == other.tileX
+                && tileY == other.tileY;
+        }
+
+        friend size_t qHash(const Key &key, size_t seed = 0)
+        {
+            return qHashMulti(seed, key.page, key.resolution, key.devicePixelRatio, key.renderHints, key.tileX, key.tileY);
+        }
+    };
+
+    /**
+     * Counters to judge the effectiveness of the cache.
+     */
+    struct Statistics {
+        //! lookups that found an image
+        quint64 hits = 0;
+
+        //! lookups that found nothing
+        quint64 misses = 0;
+
+        //! lookups that found a compressed image, counted as hits, too
+        quint64 compressedHits = 0;
+
+        //! images dropped to stay within the budget, moved to the compressed tier or not
+        quint64 evictions = 0;
+    };
+
+    /**
+     * Construct an empty cache.
+     * @param budget maximal bytes the images may use
+     * @param compressedBudget maximal bytes the compressed images may use, 0 disables the compressed tier
+     */
+    explicit ImageCache(qint64 budget = configuredBudget(), qint64 compressedBudget = configuredCompressedBudget());
+
+    /**
+     * Copies would share the usage order iterators of the original, moving keeps them valid.
+     */
+    ImageCache(const ImageCache &) = delete;
+    ImageCache &operator=(const ImageCache &) = delete;
+    ImageCache(ImageCache &&) = default;
+    ImageCache &operator=(ImageCache &&) = default;
+
+    /**
+     * Budget configured by the user, in megabytes via PageView/imageCacheSize.
+     * With PageView/imageCacheAdaptive, a quarter of the currently available system memory is used instead,
+     * at most the configured size and at least 32 megabytes, it shrinks if memory gets low.
+     * @return budget in bytes
+     */
+    static qint64 configuredBudget();
+
+    /**
+     * Budget for the compressed tier configured by the user, in megabytes via PageView/compressedImageCacheSize, 0 disables it.
+     * @return budget in bytes
+     */
+    static qint64 configuredCompressedBudget();
+
+    /**
+     * Maximal bytes the images may use.
+     * @return budget in bytes
+     */
+    qint64 budget() const
+    {
+        return m_budget;
+    }
+
+    /**
+     * Set the maximal bytes the images may use, evicts images if needed.
+     * @param budget budget in bytes
+     */
+    void setBudget(qint64 budget);
+
+    /**
+     * Bytes used by the cached images, without the compressed ones.
+     * @return used bytes
+     */
+    qint64 size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * Bytes used by the compressed images.
+     * @return used bytes
+     */
+    qint64 compressedSize() const
+    {
+        return m_compressedSize;
+    }
+
+    /**
+     * Lookup an image, marks it as recently used.
+     * A compressed image is decompressed and moves back to the uncompressed images if it fits into their budget.
+     * @param key key of the image
+     * @return image or a null image on miss
+     */
+    QImage object(const Key &key);
+
+    /**
+     * Lookup an image without counting it or marking it as used.
+     * @param key key of the image
+     * @return image or a null image if not cached uncompressed
+     */
+    QImage peek(const Key &key) const
+    {
+        return m_entries.value(key).image;
+    }
+
+    /**
+     * Is an image cached, compressed or not? Doesn't count as lookup.
+     * @param key key of the image
+     * @return image cached?
+     */
+    bool contains(const Key &key) const
+    {
+        return m_entries.contains(key) || m_compressedEntries.contains(key);
+    }
+
+    /**
+     * Insert an image, replacing an image with the same key and evicting the least recently used ones if needed.
+     * @param key key of the image
+     * @param image image to insert
+     * @return false if the image alone exceeds the budget, it is not cached then
+     */
+    bool insert(const Key &key, const QImage &image);
+
+    /**
+     * Remove an image.
+     * @param key key of the image
+     */
+    void remove(const Key &key);
+
+    /**
+     * Remove all images.
+     */
+    void clear();
+
+    /**
+     * Keys of all cached images, compressed or not.
+     * @return keys
+     */
+    QList<Key> keys() const
+    {
+        return m_entries.keys() + m_compressedEntries.keys();
+    }
+
+    /**
+     * Compress an image losslessly, opaque gray images are stored with 8 bits per pixel before the compression.
+     * Can be called from any thread.
+     * @param image image to compress
+     * @return compressed image including its format, size and device pixel ratio
+     */
+    static QByteArray compressImage(const QImage &image);
+
+    /**
+     * Restore an image compressed via compressImage(). Can be called from any thread.
+     * @param data compressed image
+     * @return image or a null image if the data is invalid
+     */
+    static QImage uncompressImage(const QByteArray &data);
+
+    /**
+     * Counters since construction.
+     * @return statistics
+     */
+    const Statistics &statistics() const
+    {
+        return m_statistics;
+    }
+
+private:
+    /**
+     * Evict least recently used images until the given bytes are used at most.
+     * @param budget bytes that may stay used
+     */
+    void trim(qint64 budget);
+
+    /**
+     * Add an evicted image to the compressed tier, evicting the least recently used compressed ones if needed.
+     * @param key key of the image
+     * @param image image to compress
+     */
+    void insertCompressed(const Key &key, const QImage &image);
+
+    /**
+     * Remove a compressed image.
+     * @param key key of the image
+     */
+    void removeCompressed(const Key &key);
+
+private:
+    /**
+     * A cached image with its position in the usage order.
+     */
+    struct Entry {
+        QImage image;
+        std::list<Key>::iterator lru;
+    };
+
+    /**
+     * cached images
+     */
+    QHash<Key, Entry> m_entries;
+
+    /**
+     * keys in usage order, most recently used first
+     */
+    std::list<Key> m_lru;
+
+    /**
+     * A compressed image with its position in the usage order of the compressed tier.
+     */
+    struct CompressedEntry {
+        QByteArray data;
+        std::list<Key>::iterator lru;
+    };
+
+    /**
+     * compressed images
+     */
+    QHash<Key, CompressedEntry> m_compressedEntries;
+
+    /**
+     * keys of the compressed images in usage order, most recently used first
+     */
+    std::list<Key> m_compressedLru;
+
+    /**
+     * maximal bytes to use for the compressed images
+     */
+    qint64 m_compressedBudget = 0;
+
+    /**
+     * bytes used by the compressed images
+     */
+    qint64 m_compressedSize = 0;
+
+    /**
+     * maximal bytes to use
+     */
+    qint64 m_budget = 0;
+
+    /**
+     * bytes used by the images
+     */
+    qint64 m_size = 0;
+
+    /**
+     * counters
+     */
+    Statistics m_statistics;
+};
@@ -130,6 +130,8 @@ int main(int argc, char *argv[])
     parser.addPositionalArgument(QStringLiteral("file"), QCoreApplication::translate("main", "PDF file to open"));
     parser.addOption(
         QCommandLineOption(QStringLiteral("port"), QCoreApplication::translate("main", "Open TCP socket to receive commands."), QStringLiteral("port")));
+    parser.addOption(QCommandLineOption(QStringLiteral("daemon"),
+                                        QCoreApplication::translate("main", "Start hidden and preload the document, show the window only on goto or activate commands.")));
     parser.process(app);
 
     /**
@@ -146,12 +148,14 @@ int main(int argc, char *argv[])
      * Construct our main window, perhaps open document passed on command line
      */
     const QStringList args = parser.positionalArguments();
-    PdfViewer viewer(args.empty() ? QString() : args.at(0), parser.value(QStringLiteral("port")).toInt());
+    const bool daemon = parser.isSet(QStringLiteral("daemon"));
+    PdfViewer viewer(args.empty() ? QString() : args.at(0), parser.value(QStringLiteral("port")).toInt(), daemon);
 
     /**
-     * just viewer and execute
+     * just viewer and execute, as daemon the commands show the viewer, e.g. context help requested
      */
-    viewer.show();
+    if (!daemon)
+        viewer.show();
     return app.exec();
 }
 
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "mappedfile.h"
+
+#include <QBuffer>
+
+std::shared_ptr<MappedFile> MappedFile::map(const QString &fileName)
+{
+    std::shared_ptr<MappedFile> mappedFile(new MappedFile(fileName));
+    if (mappedFile->m_data.isEmpty())
+        return nullptr;
+
+    return mappedFile;
+}
+
+MappedFile::MappedFile(const QString &fileName)
+    : m_file(fileName)
+{
+    if (!m_file.open(QFile::ReadOnly) || m_file.size() <= 0)
+        return;
+
+    if (uchar *memory = m_file.map(0, m_file.size()))
+        m_data = QByteArray::fromRawData(reinterpret_cast<const char *>(memory), m_file.size());
+}
+
+MappedFile::~MappedFile()
+{
+    // drop our reference to the memory before the file is unmapped on close
+    m_data.clear();
+    m_file.close();
+}
+
+std::unique_ptr<QIODevice> MappedFile::device() const
+{
+    // the buffer shares the raw data and only reads it, no detach
+    auto buffer = std::make_unique<QBuffer>();
+    buffer->setData(m_data);
+    buffer->open(QIODevice::ReadOnly);
+    return buffer;
+}
+
+bool MappedFile::isTruncated() const
+{
+    // a file replaced via rename keeps the old content alive, only shrinking in place is fatal, ask the open handle, not the path
+    return m_file.size() < m_data.size();
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+
+#include <memory>
+
+/**
+ * A read-only memory mapping of a complete file.
+ * Poppler documents can be loaded from a device() without copying the file, loadFromData() would detach the raw data
+ * and copy it. The mapping must stay alive as long as any device or Poppler document using it, therefore it is shared.
+ */
+class MappedFile
+{
+public:
+    /**
+     * Map the given file.
+     * @param fileName file to map
+     * @return mapping or nullptr if the file can't be mapped
+     */
+    static std::shared_ptr<MappedFile> map(const QString &fileName);
+
+    /**
+     * Unmap the file.
+     */
+    ~MappedFile();
+
+    /**
+     * Access to the mapped content, no copy of the data.
+     * @return mapped content
+     */
+    const QByteArray &data() const
+    {
+        return m_data;
+    }
+
+    /**
+     * Create a read-only device reading the mapped content, no copy of the data.
+     * Each Poppler document needs an own one, it keeps the read position. Can be called from any thread.
+     * @return device, must be destroyed after the Poppler document reading it and before the mapping
+     */
+    std::unique_ptr<QIODevice> device() const;
+
+    /**
+     * Was the file on disk truncated below the mapped size?
+     * Accessing the mapping beyond the new end of the file would crash, then.
+     * @return file truncated?
+     */
+    bool isTruncated() const;
+
+private:
+    /**
+     * Construct the mapping, use map().
+     * @param fileName file to map
+     */
+    MappedFile(const QString &fileName);
+
+private:
+    /**
+     * the mapped file, closing it unmaps the memory
+     */
+    QFile m_file;
+
+    /**
+     * raw data wrapper around the mapped memory
+     */
+    QByteArray m_data;
+};
@@ -43,7 +43,6 @@
 
 #include <QApplication>
 #include <QClipboard>
-#include <QtConcurrent>
 #include <QCursor>
 #include <QDebug>
 #include <QDesktopServices>
@@ -51,15 +50,55 @@
 #include <QImage>
 #include <QLabel>
 #include <QLinearGradient>
+#include <QLoggingCategory>
 #include <QMenu>
 #include <QMouseEvent>
 #include <QPainter>
 #include <QRubberBand>
 #include <QScrollBar>
 #include <QScroller>
+#include <QSet>
 #include <QShortcut>
 #include <QVariantAnimation>
 #include <QWhatsThis>
+#include <QtMath>
+
+/*
+ * defines
+ */
+
+// pages larger than this in device pixels in any direction are rendered in tiles
+#define SingleTileLimit 2048
+
+// size of the tiles in device pixels
+#define TileSize 512
+
+// resolution of the low resolution renders of whole pages shown scaled until the tiles are there
+#define BaseRenderResolution 36.0
+
+// base renders larger than this in device pixels in any direction use a lower resolution
+#define BaseRenderLimit 1024
+
+// budget for the base renders in bytes, a few hundred pages of usual sizes
+#define BaseRenderCacheSize (64 * 1024 * 1024)
+
+// pages prefetched before and after the visible ones if not scrolling
+#define DefaultPrefetchPages 3
+
+// upper limit of pages prefetched in scroll direction
+#define MaxPrefetchPages 16
+
+// milliseconds of scroll history the velocity is measured over
+#define ScrollHistoryWindow 300
+
+// milliseconds of scrolling ahead to prefetch for
+#define PrefetchTime 1000
+
+// milliseconds advance() and stepBack() count as scroll direction, one is used per read page
+#define PagingHintDuration 30000
+
+// debug output of the render caches
+Q_LOGGING_CATEGORY(lcPageView, "firstaid.pageview", QtWarningMsg)
 
 /*
  * constructors / destructor
@@ -67,14 +106,9 @@
 
 PageView::PageView(QWidget *parent)
     : QAbstractScrollArea(parent)
+    , m_baseRenders(BaseRenderCacheSize, 0)
     , m_rubberBand(new QRubberBand(QRubberBand::Rectangle, this))
-    , m_mutex(new QRecursiveMutex())
 {
-    /**
-     * allow 64 cached pages
-     */
-    m_imageCache.setMaxCost(64);
-
     // ensure we recognize pinch and swipe guestures
     grabGesture(Qt::PinchGesture);
     grabGesture(Qt::SwipeGesture);
@@ -88,9 +122,13 @@ PageView::PageView(QWidget *parent)
 
     connect(PdfViewer::document(), &Document::documentChanged, this, &PageView::slotDocumentChanged);
     connect(PdfViewer::document(), &Document::layoutChanged, this, &PageView::slotLayoutChanged);
+    connect(PdfViewer::document(), &Document::pageSizesChanged, this, &PageView::slotPageSizesChanged);
+
+    connect(&m_renderScheduler, &RenderScheduler::rendered, this, &PageView::slotTileRendered);
 
     connect(horizontalScrollBar(), &QScrollBar::valueChanged, this, &PageView::updateCurrentPage);
     connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &PageView::updateCurrentPage);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &PageView::slotVerticalScrolled);
 
     // we have static content that can be scrolled like an image
     setAttribute(Qt::WA_StaticContents);
@@ -150,11 +188,19 @@ PageView::PageView(QWidget *parent)
     connect(&m_updateViewSizeTimer, &QTimer::timeout, this, &PageView::slotUpdateViewSize);
 
     /**
-     * delays clearing of the image cache when zooming
+     * delays rendering in the new resolution when zooming
      */
-    m_clearImageCacheTimer.setSingleShot(true);
-    m_clearImageCacheTimer.setInterval(100);
-    connect(&m_clearImageCacheTimer, &QTimer::timeout, this, &PageView::slotClearImageCache);
+    m_zoomSettleTimer.setSingleShot(true);
+    m_zoomSettleTimer.setInterval(100);
+    connect(&m_zoomSettleTimer, &QTimer::timeout, this, &PageView::slotZoomSettled);
+
+    /**
+     * prefetch symmetrically again once scrolling stopped
+     */
+    m_scrollStopTimer.setSingleShot(true);
+    m_scrollStopTimer.setInterval(ScrollHistoryWindow);
+    connect(&m_scrollStopTimer, &QTimer::timeout, this, &PageView::scheduleRenders);
+    m_scrollClock.start();
 
     /**
      * initial inits
@@ -164,14 +210,47 @@ PageView::PageView(QWidget *parent)
 
 PageView::~PageView()
 {
-    delete m_mutex;
+    logCacheStatistics();
 }
 
 void PageView::slotDocumentChanged()
 {
+    logCacheStatistics();
+
+    // a reload keeps the renders of unchanged pages, the old renders of changed pages in view are shown until replaced
+    m_staleTiles.clear();
+    if (PdfViewer::document()->keptUnchangedPages()) {
+        const QRect visibleArea(offset(), viewport()->size());
+        QList<int> changedPages = PdfViewer::document()->visiblePages(toPoints(visibleArea));
+        changedPages.removeIf([](int page) { return PdfViewer::document()->pageUnchanged(page); });
+        keepStaleTiles(changedPages, tileResolution(m_zoom));
+    }
+
+    const QList<ImageCache::Key> keys = m_imageCache.keys();
+    for (const ImageCache::Key &key : keys)
+        if (!PdfViewer::document()->pageUnchanged(key.page))
+            m_imageCache.remove(key);
+    const QList<ImageCache::Key> baseKeys = m_baseRenders.keys();
+    for (const ImageCache::Key &key : baseKeys)
+        if (!PdfViewer::document()->pageUnchanged(key.page))
+            m_baseRenders.remove(key);
+
+    // the adaptive budget follows the memory available now
+    m_imageCache.setBudget(ImageCache::configuredBudget());
+
+    // oversized tiles are kept like the cached ones, renders still on the way are for the old document
+    const QList<ImageCache::Key> oversizedKeys = m_oversizedTiles.keys();
+    for (const ImageCache::Key &key : oversizedKeys)
+        if (!PdfViewer::document()->pageUnchanged(key.page))
+            m_oversizedTiles.remove(key);
+    m_renderScheduler.cancel();
+
     m_currentPage = -1;
 
     m_historyStack.clear();
+    m_highlightedMatchPage = -1;
+    m_scrollHistory.clear();
+    m_pagingDirection = 0;
 
     // visual size of document might change now!
     updateViewSize();
@@ -192,11 +271,73 @@ void PageView::slotLayoutChanged()
     gotoPage(currentPage);
 }
 
+void PageView::slotPageSizesChanged(const QList<int> &pages)
+{
+    // the tiles of these pages were cut with the provisional size
+    const QList<ImageCache::Key> keys = m_imageCache.keys();
+    for (const ImageCache::Key &key : keys)
+        if (pages.contains(key.page))
+            m_imageCache.remove(key);
+    const QList<ImageCache::Key> baseKeys = m_baseRenders.keys();
+    for (const ImageCache::Key &key : baseKeys)
+        if (pages.contains(key.page))
+            m_baseRenders.remove(key);
+    const QList<ImageCache::Key> oversizedKeys = m_oversizedTiles.keys();
+    for (const ImageCache::Key &key : oversizedKeys)
+        if (pages.contains(key.page))
+            m_oversizedTiles.remove(key);
+    for (int page : pages)
+        m_staleTiles.remove(page);
+
+    // renders on the way might use the old size, the relayout repaints all and schedules again
+    m_renderScheduler.cancel();
+}
+
 int PageView::currentPage() const
 {
     return m_currentPage;
 }
 
+void PageView::stopRendering()
+{
+    m_renderScheduler.stop();
+}
+
+PageView::Renders PageView::takeRenders()
+{
+    // running renders are for the document going away
+    m_renderScheduler.cancel();
+
+    Renders renders{ImageCache(m_imageCache.budget()), ImageCache(BaseRenderCacheSize, 0)};
+    std::swap(renders.images, m_imageCache);
+    std::swap(renders.baseRenders, m_baseRenders);
+    return renders;
+}
+
+void PageView::restoreRenders(Renders &&renders)
+{
+    // the budget might have changed meanwhile
+    renders.images.setBudget(m_imageCache.budget());
+    m_imageCache = std::move(renders.images);
+    m_baseRenders = std::move(renders.baseRenders);
+    viewport()->update();
+}
+
+void PageView::preload(int page)
+{
+    if (page < 0 || page >= PdfViewer::document()->numPages())
+        return;
+
+    // the size of a hidden view is not final, base renders don't depend on it, tiles come from the disk cache once shown
+    QList<RenderScheduler::Job> jobs;
+    addBaseRenderJob(jobs, page, RenderScheduler::Visible);
+    if (page + 1 < PdfViewer::document()->numPages())
+        addBaseRenderJob(jobs, page + 1, RenderScheduler::Adjacent);
+    if (page > 0)
+        addBaseRenderJob(jobs, page - 1, RenderScheduler::Adjacent);
+    m_renderScheduler.schedule(jobs);
+}
+
 void PageView::setZoomMode(ZoomMode mode)
 {
     if (mode != m_zoomMode) {
@@ -230,28 +371,75 @@ void PageView::wheelEvent(QWheelEvent *wheelEvent)
     QAbstractScrollArea::wheelEvent(wheelEvent);
 }
 
+void PageView::scrollContentsBy(int dx, int dy)
+{
+    // move what is painted already, only the exposed strip needs a paint, children like the hint label stay
+    viewport()->scroll(dx, dy, viewport()->rect());
+}
+
 void PageView::slotUpdateViewSize()
 {
     updateViewSize();
 }
 
-void PageView::slotClearImageCache()
+void PageView::slotZoomSettled()
 {
-    QMutexLocker locker(m_mutex);
-    m_imageCache.clear();
-    m_usePageRect = false;
+    // render the visible tiles in the new resolution now
+    m_zoomSettling = false;
     viewport()->update();
 }
 
-void PageView::prerender(int firstPage, int lastPage, int numberOfPages)
+void PageView::slotVerticalScrolled(int value)
 {
-    for (int i = 1; i <= 3; ++i)
-        if (numberOfPages > lastPage + i)
-            getPage(lastPage + i);
+    // keep one sample before the window as base
+    const qint64 now = m_scrollClock.elapsed();
+    m_scrollHistory.append(qMakePair(now, value));
+    while (m_scrollHistory.size() > 2 && now - m_scrollHistory.at(1).first > ScrollHistoryWindow)
+        m_scrollHistory.removeFirst();
+
+    m_scrollStopTimer.start();
+}
+
+void PageView::slotTileRendered(const ImageCache::Key &key, const QImage &image)
+{
+    // base renders fit any zoom
+    if (isBaseRender(key)) {
+        m_baseRenders.insert(key, image);
+        viewport()->update(fromPoints(PdfViewer::document()->pageRect(key.page)).translated(-offset()));
+        return;
+    }
+
+    const QRect visibleArea(offset(), viewport()->size());
+    const QList<int> visiblePages = PdfViewer::document()->visiblePages(toPoints(visibleArea));
 
-    for (int i = 1; i <= 3; ++i)
-        if (firstPage - i >= 0)
-            getPage(firstPage - i);
+    // tiles too large for the cache are kept while their page is visible, else we would render them again and again
+    if (!m_imageCache.insert(key, image)) {
+        const QList<ImageCache::Key> oversizedKeys = m_oversizedTiles.keys();
+        for (const ImageCache::Key &oversizedKey : oversizedKeys)
+            if (!visiblePages.contains(oversizedKey.page))
+                m_oversizedTiles.remove(oversizedKey);
+        m_oversizedTiles.insert(key, image);
+    }
+
+    // stale renders are obsolete for pages out of view or once all tiles in view are there
+    const QList<int> stalePages = m_staleTiles.keys();
+    for (int page : stalePages) {
+        bool obsolete = !visiblePages.contains(page);
+        if (!obsolete && page == key.page) {
+            obsolete = true;
+            for (const auto &tile : tiles(page, visibleArea))
+                obsolete = obsolete && (m_imageCache.contains(tile.first) || m_oversizedTiles.contains(tile.first));
+        }
+
+        if (obsolete)
+            m_staleTiles.remove(page);
+    }
+
+    // repaint only the rendered tile, if still in the current resolution
+    if (key.resolution == tileResolution(m_zoom) && key.devicePixelRatio == devicePixelRatioF()) {
+        const QPointF topLeft = QPointF(fromPoints(PdfViewer::document()->pageRect(key.page)).topLeft()) + QPointF(key.tileX * TileSize, key.tileY * TileSize) / key.devicePixelRatio;
+        viewport()->update(QRectF(topLeft, QSizeF(image.size()) / key.devicePixelRatio).toAlignedRect().translated(-offset()));
+    }
 }
 
 void PageView::updateCurrentPage()
@@ -260,10 +448,6 @@ void PageView::updateCurrentPage()
     const int page = qMax(0, PdfViewer::document()->pageForRect(toPoints(QRect(offset(), viewport()->size()))));
     if (page != m_currentPage) {
         m_currentPage = page;
-        QList<int> pages = PdfViewer::document()->visiblePages(toPoints(QRect(offset(), viewport()->size())));
-        if (!pages.isEmpty()) {
-            const auto future = QtConcurrent::run(&PageView::prerender, this, pages.first(), pages.last(), PdfViewer::document()->numPages());
-        }
         emit pageChanged(m_currentPage);
     }
 }
@@ -355,32 +539,37 @@ void PageView::paintEvent(QPaintEvent *paintEvent)
     p.translate(-offset());
 
     // get the current match that should be highlighted differently
-    int matchPage;
-    QRectF matchRect;
-    PdfViewer::searchEngine()->currentMatch(matchPage, matchRect);
+    int currentMatchPage;
+    QRectF currentMatchRect;
+    PdfViewer::searchEngine()->currentMatch(currentMatchPage, currentMatchRect);
 
     // paint all visible pages
     for (int page : PdfViewer::document()->visiblePages(toPoints(paintEvent->rect().translated(offset())))) {
         QRectF pageRect = PdfViewer::document()->pageRect(page);
         QRect displayRect = fromPoints(pageRect);
 
-        QImage cachedPage = getPage(page);
-        if (m_usePageRect)
-            p.drawImage(displayRect, cachedPage);
-        else
-            p.drawImage(displayRect.topLeft(), cachedPage);
+        // never wait for a render: placeholder, the base render and renders at an old zoom scaled and then the tiles we have
+        p.fillRect(displayRect, Qt::white);
+        const QImage baseImage = m_baseRenders.object(baseRenderKey(page));
+        if (!baseImage.isNull())
+            p.drawImage(displayRect, baseImage);
+        for (const StaleTile &tile : m_staleTiles.value(page))
+            p.drawImage(fromPoints(tile.rect.translated(pageRect.topLeft())), tile.image);
+
+        for (const auto &tile : tiles(page, paintEvent->rect().translated(offset()))) {
+            QImage image = m_imageCache.object(tile.first);
+            if (image.isNull())
+                image = m_oversizedTiles.value(tile.first);
+
+            if (!image.isNull())
+                p.drawImage(QPointF(displayRect.topLeft()) + QPointF(tile.second.topLeft()) / devicePixelRatioF(), image);
+        }
 
         p.setPen(Qt::NoPen);
 
         // paint any matches on the current page
         for (const QRectF &rect : PdfViewer::searchEngine()->matchesFor(page)) {
-            QColor matchColor = QColor(255, 255, 0, 64);
-            if (page == matchPage && rect == matchRect)
-                matchColor = QColor(255, 128, 0, 128);
-
-            QRect r = fromPoints(rect);
-            r.adjust(-3, -5, 3, 2);
-            p.fillRect(r.translated(displayRect.topLeft()), matchColor);
+            p.fillRect(matchRect(page, rect), (page == currentMatchPage && rect == currentMatchRect) ? highlightColor() : matchColor());
         }
 
         // draw border around page
@@ -406,6 +595,9 @@ void PageView::paintEvent(QPaintEvent *paintEvent)
 
         p.fillRect(r, lg);
     }
+
+    // the visible area might have changed, queue what is missing, most important first
+    scheduleRenders();
 }
 
 void PageView::resizeEvent(QResizeEvent *resizeEvent)
@@ -457,11 +649,9 @@ void PageView::mouseMoveEvent(QMouseEvent *event)
         qreal yPos = (offset().y() + event->position().y() - pageRect.y()) / (qreal)pageRect.height();
         QPointF p = QPointF(xPos, yPos);
 
-        for (auto &l : PdfViewer::document()->links(page)) {
-            if (l->boundary().contains(p)) {
-                setCursor(Qt::PointingHandCursor);
-                return;
-            }
+        if (PdfViewer::document()->linkAt(page, p)) {
+            setCursor(Qt::PointingHandCursor);
+            return;
         }
     }
 
@@ -508,50 +698,43 @@ void PageView::mousePressEvent(QMouseEvent *event)
         qreal yPos = (offset().y() + event->position().y() - pixelPageRect.y()) / (qreal)pixelPageRect.height();
         QPointF p = QPointF(xPos, yPos);
 
-        for (auto &l : PdfViewer::document()->links(page)) {
-            if (l->boundary().contains(p)) {
-                m_mousePressPage = page;
-                m_mousePressPageRect = QRectF(pageRect.width() * l->boundary().left(), pageRect.height() * l->boundary().top(), pageRect.width() * l->boundary().width(), pageRect.height() * l->boundary().height());
-
-                if (Poppler::Annotation::ALink == l->subType()) {
-                    if (Poppler::Link *link = static_cast<Poppler::LinkAnnotation *>(l.get())->linkDestination()) {
-                        switch (link->linkType()) {
-                            case Poppler::Link::Goto: {
-                                Poppler::LinkDestination gotoLink = static_cast<Poppler::LinkGoto *>(link)->destination();
-                                m_mousePressLinkPage = gotoLink.pageNumber() - 1;
-
-                                m_mousePressLinkPageRect = QRectF();
-                                if (gotoLink.left() > 0) {
-                                    m_mousePressLinkPageRect.setLeft(gotoLink.left() * pageRect.width());
-                                    m_mousePressLinkPageRect.setRight(1 + gotoLink.left() * pageRect.width());
-                                }
-                                if (gotoLink.top() > 0) {
-                                    m_mousePressLinkPageRect.setTop(gotoLink.top() * pageRect.height());
-                                    m_mousePressLinkPageRect.setBottom(1 + gotoLink.top() * pageRect.height());
-                                }
-                                if (gotoLink.right() > 0)
-                                    m_mousePressLinkPageRect.setRight(gotoLink.right() * pageRect.width());
-                                if (gotoLink.bottom() > 0 && gotoLink.bottom() < 1.0)
-                                    m_mousePressLinkPageRect.setBottom(gotoLink.bottom() * pageRect.height());
-
-                                m_mousePressLinkPageRect = m_mousePressLinkPageRect.intersected(pageRect.translated(-pageRect.topLeft()));
-                            } break;
-
-                            case Poppler::Link::Browse:
-                                m_mousePressLinkUrl = static_cast<Poppler::LinkBrowse *>(link)->url();
-                                break;
-
-                            default:
-                                break;
-                        }
+        if (const Document::Link *l = PdfViewer::document()->linkAt(page, p)) {
+            m_mousePressPage = page;
+            m_mousePressPageRect = QRectF(pageRect.width() * l->boundary.left(), pageRect.height() * l->boundary.top(), pageRect.width() * l->boundary.width(), pageRect.height() * l->boundary.height());
+
+            if (Document::Link::Note == l->type) {
+                QWhatsThis::showText(event->globalPosition().toPoint(), l->contents);
+                return;
+            }
+
+            switch (l->type) {
+                case Document::Link::Goto: {
+                    Poppler::LinkDestination gotoLink(l->destination);
+                    m_mousePressLinkPage = gotoLink.pageNumber() - 1;
+
+                    m_mousePressLinkPageRect = QRectF();
+                    if (gotoLink.left() > 0) {
+                        m_mousePressLinkPageRect.setLeft(gotoLink.left() * pageRect.width());
+                        m_mousePressLinkPageRect.setRight(1 + gotoLink.left() * pageRect.width());
+                    }
+                    if (gotoLink.top() > 0) {
+                        m_mousePressLinkPageRect.setTop(gotoLink.top() * pageRect.height());
+                        m_mousePressLinkPageRect.setBottom(1 + gotoLink.top() * pageRect.height());
                     }
+                    if (gotoLink.right() > 0)
+                        m_mousePressLinkPageRect.setRight(gotoLink.right() * pageRect.width());
+                    if (gotoLink.bottom() > 0 && gotoLink.bottom() < 1.0)
+                        m_mousePressLinkPageRect.setBottom(gotoLink.bottom() * pageRect.height());
+
+                    m_mousePressLinkPageRect = m_mousePressLinkPageRect.intersected(pageRect.translated(-pageRect.topLeft()));
+                } break;
+
+                case Document::Link::Browse:
+                    m_mousePressLinkUrl = l->url;
                     break;
-                }
 
-                else if (Poppler::Annotation::AText == l->subType() || Poppler::Annotation::ACaret == l->subType()) {
-                    QWhatsThis::showText(event->globalPosition().toPoint(), l->contents());
-                    return;
-                }
+                default:
+                    break;
             }
         }
     }
@@ -664,6 +847,7 @@ void PageView::gotoPage(int page, const QRectF &rectToBeVisibleInPoints, bool hi
             }
         }
 
+        const QRect oldHighlightRect = m_highlightRect;
         m_highlightRect = fromPoints(adjustedRectToBeVisibleInPoints.translated(pageRectInPoints.topLeft()));
         if (m_highlightRect.height() < 50 * m_zoom) {
             m_highlightRect.setHeight(50 * m_zoom);
@@ -671,6 +855,9 @@ void PageView::gotoPage(int page, const QRectF &rectToBeVisibleInPoints, bool hi
             m_highlightRect.adjust(1, 0, -1, 0);
         }
 
+        // the old highlight might still be visible, the animation only repaints the new one
+        viewport()->update(oldHighlightRect.translated(-offset()));
+
         // start animation
         QVariantAnimation *va = new QVariantAnimation(this);
         connect(va, &QVariantAnimation::valueChanged, this, &PageView::slotAnimationValueChanged);
@@ -725,11 +912,6 @@ void PageView::gotoPage(int page, const QRectF &rectToBeVisibleInPoints, bool hi
     if (!visibleRect.contains(toBeVisibleInPixel))
         setOffset(toBeVisibleInPixel.topLeft());
 
-    /**
-     * trigger repaint in any case
-     */
-    viewport()->update();
-
     /**
      * inform objects about the actual requested page
      */
@@ -762,6 +944,10 @@ void PageView::stepBack()
     if (-1 == m_currentPage)
         return;
 
+    // prefetch the previous pages, someone paging is likely to continue
+    m_pagingDirection = -1;
+    m_pagingTime = m_scrollClock.elapsed();
+
     // go to start of current page if not visible or to previous page
     QRect pageRect = fromPoints(PdfViewer::document()->pageRect(m_currentPage));
     QRect visibleRect = QRect(offset(), viewport()->size());
@@ -789,6 +975,10 @@ void PageView::advance()
     if (-1 == m_currentPage)
         return;
 
+    // prefetch the next pages, someone paging is likely to continue
+    m_pagingDirection = 1;
+    m_pagingTime = m_scrollClock.elapsed();
+
     // go to end of current page if not visible or to next page
     QRect pageRect = fromPoints(PdfViewer::document()->pageRect(m_currentPage));
     QRect visibleRect = QRect(offset(), viewport()->size());
@@ -830,12 +1020,8 @@ void PageView::historyNext()
 
 void PageView::gotoDestinationName(const QString &destination, bool updateHistory, bool downwards)
 {
-    // try to lookup
-    if (auto link = PdfViewer::document()->linkDestination(destination)) {
-        // call function that takes description, skip that if page is already bogus
-        if (link->pageNumber() > 0)
-            gotoDestination(link->toString(), updateHistory, downwards);
-    }
+    // resolved names are remembered by the document, bogus ones are empty
+    gotoDestination(PdfViewer::document()->resolveDestination(destination), updateHistory, downwards);
 }
 void PageView::gotoDestination(const QString &destination, bool updateHistory, bool downwards)
 {
@@ -888,27 +1074,37 @@ void PageView::slotCopyRequested(int page, const QRect &viewportRect)
 
 void PageView::slotFindStarted()
 {
+    // all old matches are gone
+    m_highlightedMatchPage = -1;
     viewport()->update();
 }
 
 void PageView::slotHighlightMatch(int page, const QRectF &rect, bool searchWrapped)
 {
+    // only the old and the new current match change their color, scrolling repaints what gets exposed
+    if (m_highlightedMatchPage >= 0 && m_highlightedMatchPage < PdfViewer::document()->numPages())
+        viewport()->update(matchRect(m_highlightedMatchPage, m_highlightedMatch).translated(-offset()));
+    m_highlightedMatchPage = page;
+    m_highlightedMatch = rect;
+
     gotoPage(page, rect, false);
+    viewport()->update(matchRect(page, rect).translated(-offset()));
 
     if (searchWrapped)
         showHint(QStringLiteral("<b>Search wrapped</b>"));
 }
 
-void PageView::slotMatchesFound(int page, const QList<QRectF> &)
+void PageView::slotMatchesFound(int page, const QList<QRectF> &matches)
 {
-    if (page == m_currentPage)
-        viewport()->update();
+    // repaint only the new matches
+    for (const QRectF &rect : matches)
+        viewport()->update(matchRect(page, rect).translated(-offset()));
 }
 
 void PageView::slotAnimationValueChanged(const QVariant &value)
 {
     m_highlightValue = value.toInt();
-    viewport()->update();
+    viewport()->update(m_highlightRect.translated(-offset()));
 }
 
 /*
@@ -918,11 +1114,10 @@ void PageView::slotAnimationValueChanged(const QVariant &value)
 void PageView::updateViewSize(qreal zoom)
 {
     /**
-     * invalidate cache delayed
-     * we might alter sizes
+     * remember zoom and visible pages to detect changes
      */
-    m_clearImageCacheTimer.start();
-    m_usePageRect = true;
+    const qreal oldZoom = m_zoom;
+    const QList<int> oldVisiblePages = PdfViewer::document()->visiblePages(toPoints(QRect(offset(), viewport()->size())));
 
     /**
      * remember current center of viewport
@@ -946,6 +1141,17 @@ void PageView::updateViewSize(qreal zoom)
         }
     }
 
+    /**
+     * render in the new resolution delayed if the zoom changed, collapses fast zooming
+     * renders at the old zoom are scaled until then
+     */
+    if (m_zoom != oldZoom) {
+        keepStaleTiles(oldVisiblePages, tileResolution(oldZoom));
+        m_scrollHistory.clear();
+        m_zoomSettleTimer.start();
+        m_zoomSettling = true;
+    }
+
     /**
      * update ranges of scrollbars, after zoom is adjusted if needed
      */
@@ -977,40 +1183,215 @@ void PageView::updateViewSize(qreal zoom)
     viewport()->update();
 }
 
-QImage PageView::getPage(int pageNumber)
+QRect PageView::matchRect(int page, const QRectF &rect) const
 {
-    QMutexLocker locker(m_mutex);
-    /**
-     * prefer cached image
-     */
-    if (QImage *cachedPage = m_imageCache.object(pageNumber))
-        return *cachedPage;
+    // some margin around the text
+    return fromPoints(rect).adjusted(-3, -5, 3, 2).translated(fromPoints(PdfViewer::document()->pageRect(page)).topLeft());
+}
 
-    /**
-     * try to get poppler page => render
-     */
-    if (Poppler::Page *page = PdfViewer::document()->page(pageNumber)) {
-        // unlock to block less
-        locker.unlock();
+QList<QPair<ImageCache::Key, QRect>> PageView::tiles(int page, const QRect &area) const
+{
+    QList<QPair<ImageCache::Key, QRect>> tiles;
+    const QRect displayRect = fromPoints(PdfViewer::document()->pageRect(page));
+    const QRect visibleRect = displayRect.intersected(area);
+    if (visibleRect.isEmpty())
+        return tiles;
+
+    // page size in device pixels, small pages are one tile with a null rectangle
+    // keyed by resolution, renders of an earlier zoom are found again when returning to it
+    const qreal dpr = devicePixelRatioF();
+    const qreal res = tileResolution(m_zoom);
+    const int hints = PdfViewer::document()->renderHints();
+    const QSizeF pageSize = PdfViewer::document()->pageSize(page);
+    const QRect renderRect(0, 0, qCeil(pageSize.width() / 72.0 * res * dpr), qCeil(pageSize.height() / 72.0 * res * m_dpiY / m_dpiX * dpr));
+    if (renderRect.width() <= SingleTileLimit && renderRect.height() <= SingleTileLimit) {
+        tiles.append(qMakePair(ImageCache::Key{page, res, dpr, hints, 0, 0}, QRect()));
+        return tiles;
+    }
 
-        /**
-         * we render in too high resolution and then set the right ratio
-         */
-        QImage *cachedPage = new QImage(page->renderToImage(resX() * devicePixelRatioF(), resY() * devicePixelRatioF(), -1, -1, -1, -1, Poppler::Page::Rotate0));
-        cachedPage->setDevicePixelRatio(devicePixelRatioF());
+    // only the tiles overlapping the area, in device pixels relative to the page
+    const QRect neededRect = QRectF(QPointF(visibleRect.topLeft() - displayRect.topLeft()) * dpr, QSizeF(visibleRect.size()) * dpr).toAlignedRect().intersected(renderRect);
+    for (int y = neededRect.top() / TileSize; y <= neededRect.bottom() / TileSize; ++y)
+        for (int x = neededRect.left() / TileSize; x <= neededRect.right() / TileSize; ++x)
+            tiles.append(qMakePair(ImageCache::Key{page, res, dpr, hints, x, y}, QRect(x * TileSize, y * TileSize, TileSize, TileSize).intersected(renderRect)));
+
+    return tiles;
+}
+
+void PageView::scheduleRenders()
+{
+    QList<RenderScheduler::Job> jobs;
+    QSet<ImageCache::Key> keys;
+    auto addTiles = [this, &jobs, &keys](int page, const QRect &area, RenderScheduler::Priority priority) {
+        // the first request of a tile has the highest priority
+        Poppler::Page *popplerPage = nullptr;
+        for (const auto &tile : tiles(page, area)) {
+            if (keys.contains(tile.first) || m_imageCache.contains(tile.first) || m_oversizedTiles.contains(tile.first))
+                continue;
+
+            if (!popplerPage && !(popplerPage = PdfViewer::document()->page(page)))
+                return;
+
+            // we render in too high resolution and then set the right ratio
+            keys.insert(tile.first);
+            const qreal res = tile.first.resolution * tile.first.devicePixelRatio;
+            // tiles cut with a provisional page size are not worth keeping
+            const QByteArray fingerprint = PdfViewer::document()->pageSizeProvisional(page) ? QByteArray() : PdfViewer::document()->fingerprint();
+            jobs.append(RenderScheduler::Job{tile.first, tile.second, res, res * m_dpiY / m_dpiX, popplerPage, priority, fingerprint});
+        }
+    };
+
+    // cheap base renders first, they are shown at any zoom, even while zooming
+    const QRect visibleArea(offset(), viewport()->size());
+    const QList<int> visiblePages = PdfViewer::document()->visiblePages(toPoints(visibleArea));
+    for (int page : visiblePages)
+        addBaseRenderJob(jobs, page, RenderScheduler::Visible);
+    if (!visiblePages.isEmpty()) {
+        if (visiblePages.last() + 1 < PdfViewer::document()->numPages())
+            addBaseRenderJob(jobs, visiblePages.last() + 1, RenderScheduler::Adjacent);
+        if (visiblePages.first() > 0)
+            addBaseRenderJob(jobs, visiblePages.first() - 1, RenderScheduler::Adjacent);
+    }
+
+    // no tiles in the new resolution while zooming, the jobs for the old zoom are aborted
+    if (!m_zoomSettling && !visiblePages.isEmpty()) {
+        // what is visible first, then a margin around it and the start of the next and previous page
+        for (int page : visiblePages)
+            addTiles(page, visibleArea, RenderScheduler::Visible);
+
+        const int margin = qCeil(TileSize / devicePixelRatioF());
+        for (int page : visiblePages)
+            addTiles(page, visibleArea.adjusted(-margin, -margin, margin, margin), RenderScheduler::Adjacent);
+
+        // the part of the pages further away that is shown first when scrolling there, more in scroll direction
+        const QPair<int, int> window = prefetchWindow(visiblePages);
+        for (int i = 1; i <= qMax(window.first, window.second); ++i) {
+            const RenderScheduler::Priority priority = (i == 1) ? RenderScheduler::Adjacent : RenderScheduler::Speculative;
+
+            const int nextPage = visiblePages.last() + i;
+            if (i <= window.second && nextPage < PdfViewer::document()->numPages()) {
+                const QRect displayRect = fromPoints(PdfViewer::document()->pageRect(nextPage));
+                addTiles(nextPage, QRect(QPoint(offset().x(), displayRect.top()), viewport()->size()), priority);
+            }
+
+            const int previousPage = visiblePages.first() - i;
+            if (i <= window.first && previousPage >= 0) {
+                const QRect displayRect = fromPoints(PdfViewer::document()->pageRect(previousPage));
+                addTiles(previousPage, QRect(QPoint(offset().x(), displayRect.bottom() - viewport()->height()), viewport()->size()), priority);
+            }
+        }
+    }
+
+    m_renderScheduler.schedule(jobs);
+}
+
+void PageView::addBaseRenderJob(QList<RenderScheduler::Job> &jobs, int page, RenderScheduler::Priority priority) const
+{
+    const ImageCache::Key key = baseRenderKey(page);
+    if (m_baseRenders.contains(key))
+        return;
+
+    Poppler::Page *popplerPage = PdfViewer::document()->page(page);
+    if (!popplerPage)
+        return;
+
+    const QSizeF pageSize = PdfViewer::document()->pageSize(page);
+    const qreal res = qMin(BaseRenderResolution, BaseRenderLimit * 72.0 / qMax(qreal(1), qMax(pageSize.width(), pageSize.height())));
+    const QByteArray fingerprint = PdfViewer::document()->pageSizeProvisional(page) ? QByteArray() : PdfViewer::document()->fingerprint();
+    jobs.append(RenderScheduler::Job{key, QRect(), res, res, popplerPage, priority, fingerprint});
+}
+
+qreal PageView::scrollVelocity() const
+{
+    // measured up to now, decays once scrolling stops
+    if (m_scrollHistory.size() < 2)
+        return 0;
+
+    const qint64 elapsed = qMax(qint64(1), m_scrollClock.elapsed() - m_scrollHistory.first().first);
+    return (m_scrollHistory.last().second - m_scrollHistory.first().second) * 1000.0 / elapsed;
+}
 
-        // relock before we modify the cache
-        locker.relock();
-        if (m_imageCache.insert(pageNumber, cachedPage))
-            return *cachedPage;
+QPair<int, int> PageView::prefetchWindow(const QList<int> &visiblePages) const
+{
+    // direction from scrolling faster than half a viewport per second, else from recent paging
+    const qreal velocity = scrollVelocity();
+    int direction = 0;
+    if (qAbs(velocity) * 2 >= viewport()->height())
+        direction = (velocity > 0) ? 1 : -1;
+    else if (m_pagingDirection != 0 && m_scrollClock.elapsed() - m_pagingTime < PagingHintDuration)
+        direction = m_pagingDirection;
+
+    // the pages passed during the next PrefetchTime milliseconds, paging counts as one page per second
+    const QRect displayRect = fromPoints(PdfViewer::document()->pageRect(visiblePages.last(), true));
+    const qreal pixelsAhead = qMax(qAbs(velocity), qreal(displayRect.height())) * PrefetchTime / 1000.0;
+    int before = DefaultPrefetchPages;
+    int after = DefaultPrefetchPages;
+    if (direction != 0) {
+        const int ahead = qMin(MaxPrefetchPages, DefaultPrefetchPages + qCeil(pixelsAhead / qMax(1, displayRect.height())));
+        before = (direction < 0) ? ahead : 0;
+        after = (direction > 0) ? ahead : 0;
+    }
+
+    // never more than fits into the cache next to the visible tiles, prefetching must not evict them
+    // a prefetched page uses at most a viewport plus a tile in each direction
+    const qreal dpr = devicePixelRatioF();
+    const QSize prefetchSize = displayRect.size().boundedTo(viewport()->size() + QSize(qCeil(TileSize / dpr), qCeil(TileSize / dpr)));
+    const qint64 pageBytes = qMax(qint64(1), qint64(prefetchSize.width() * dpr) * qint64(prefetchSize.height() * dpr) * 4);
+    const qint64 fittingPages = qMax(qint64(0), (m_imageCache.budget() - (visiblePages.size() + 1) * pageBytes) / pageBytes);
+    while (before + after > fittingPages) {
+        if (before > after)
+            --before;
         else
-            return QImage();
+            --after;
     }
 
-    /**
-     * else return empty image
-     */
-    return QImage();
+    return qMakePair(before, after);
+}
+
+ImageCache::Key PageView::baseRenderKey(int page)
+{
+    return ImageCache::Key{page, 0.0, 1.0, PdfViewer::document()->renderHints(), 0, 0};
+}
+
+void PageView::keepStaleTiles(const QList<int> &pages, qreal resolution)
+{
+    // the newest renders of the given pages replace older stale ones, other pages are dropped
+    QHash<int, QList<StaleTile>> staleTiles;
+    for (int page : pages)
+        if (m_staleTiles.contains(page))
+            staleTiles.insert(page, m_staleTiles.value(page));
+
+    QHash<int, QList<StaleTile>> renderedTiles;
+    auto addTile = [this, &pages, resolution, &renderedTiles](const ImageCache::Key &key, const QImage &image) {
+        // only tiles in the given resolution, the position in points relative to the page doesn't depend on the zoom
+        if (image.isNull() || !pages.contains(key.page) || key.resolution != resolution || key.devicePixelRatio != devicePixelRatioF())
+            return;
+
+        const qreal scaleX = 72.0 / (key.resolution * key.devicePixelRatio);
+        const qreal scaleY = 72.0 / (key.resolution * m_dpiY / m_dpiX * key.devicePixelRatio);
+        renderedTiles[key.page].append(StaleTile{QRectF(key.tileX * TileSize * scaleX, key.tileY * TileSize * scaleY, image.width() * scaleX, image.height() * scaleY), image});
+    };
+
+    for (const ImageCache::Key &key : m_imageCache.keys())
+        addTile(key, m_imageCache.peek(key));
+    for (auto it = m_oversizedTiles.cbegin(); it != m_oversizedTiles.cend(); ++it)
+        addTile(it.key(), it.value());
+
+    for (auto it = renderedTiles.cbegin(); it != renderedTiles.cend(); ++it)
+        staleTiles.insert(it.key(), it.value());
+
+    m_staleTiles = staleTiles;
+}
+
+void PageView::logCacheStatistics() const
+{
+    // counted since the caches were created, clearing them keeps the counters, resident documents take theirs along
+    const ImageCache::Statistics &images = m_imageCache.statistics();
+    qCDebug(lcPageView) << "image cache:" << images.hits << "hits," << images.compressedHits << "of them compressed," << images.misses << "misses," << images.evictions
+                        << "evictions," << m_imageCache.size() << "of" << m_imageCache.budget() << "bytes used," << m_imageCache.compressedSize() << "compressed";
+
+    const ImageCache::Statistics &baseRenders = m_baseRenders.statistics();
+    qCDebug(lcPageView) << "base renders:" << baseRenders.hits << "hits," << baseRenders.misses << "misses," << baseRenders.evictions << "evictions";
 }
 
 QSize PageView::sizeHint() const
@@ -25,15 +25,17 @@
 #include <memory>
 
 #include <QAbstractScrollArea>
-#include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QImage>
-#include <QRecursiveMutex>
 #include <QTimer>
 
 #include <poppler-qt6.h>
 
 #include "document.h"
 #include "historystack.h"
+#include "imagecache.h"
+#include "renderscheduler.h"
 
 class QLabel;
 class QRubberBand;
@@ -71,6 +73,50 @@ public:
     QPoint offset() const;
     int currentPage() const;
 
+    /**
+     * Abort all background renders and wait for them, must be called before the document changes.
+     */
+    void stopRendering();
+
+    /**
+     * Renders of a document, kept while another document is shown.
+     */
+    struct Renders {
+        //! rendered tiles
+        ImageCache images;
+
+        //! low resolution renders of the pages
+        ImageCache baseRenders;
+
+        /**
+         * Bytes used by the renders, compressed ones included.
+         * @return used bytes
+         */
+        qint64 size() const
+        {
+            return images.size() + images.compressedSize() + baseRenders.size() + baseRenders.compressedSize();
+        }
+    };
+
+    /**
+     * Take the renders of the current document, must be called before the document changes, leaves empty caches.
+     * @return renders
+     */
+    Renders takeRenders();
+
+    /**
+     * Use the renders taken before for the same document, must be called after the document changed.
+     * @param renders renders to use
+     */
+    void restoreRenders(Renders &&renders);
+
+    /**
+     * Queue the renders needed to show the given page while the view is hidden and gets no paint events,
+     * e.g. in resident mode, the first paint after showing finds at least the base renders cached.
+     * @param page page to show later
+     */
+    void preload(int page);
+
 public slots:
     void setZoomMode(PageView::ZoomMode mode);
     void setZoom(qreal zoom);
@@ -133,6 +179,7 @@ protected:
     void mousePressEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void wheelEvent(QWheelEvent *wheelEvent) override;
+    void scrollContentsBy(int dx, int dy) override;
 
     void showHint(const QString &text, int timeout = 3000);
 
@@ -144,11 +191,28 @@ private slots:
     void slotUpdateViewSize();
 
     /**
-     * slot to trigger clearing of image cache
+     * slot to start rendering in the new resolution once zooming settled
      */
-    void slotClearImageCache();
+    void slotZoomSettled();
 
-    void prerender(int firstPage, int lastPage, int numberOfPages);
+    /**
+     * slot called with a finished background render
+     * @param key rendered tile
+     * @param image rendered image
+     */
+    void slotTileRendered(const ImageCache::Key &key, const QImage &image);
+
+    /**
+     * slot called once provisional page sizes were corrected, drops the renders of the pages
+     * @param pages pages with a changed size
+     */
+    void slotPageSizesChanged(const QList<int> &pages);
+
+    /**
+     * slot to record the scroll history for the prefetching
+     * @param value new value of the vertical scrollbar
+     */
+    void slotVerticalScrolled(int value);
 
 private:
     /**
@@ -239,12 +303,91 @@ private:
     }
 
     /**
-     * Get prerendered image for given page.
-     * Uses some cache to not render the last X pages again and again.
-     * @param page requested page
-     * @return rendered page as image, HiDPI aware
+     * Area a search match covers when painted.
+     * @param page page of the match
+     * @param rect match in points relative to the page
+     * @return area in the viewport coordinates of the complete layout
+     */
+    QRect matchRect(int page, const QRectF &rect) const;
+
+    /**
+     * Tiles of the given page in the current resolution that overlap the given area.
+     * Small pages are rendered as a whole, large ones in TileSize tiles via the x/y/w/h arguments of renderToImage.
+     * @param page page to get the tiles for
+     * @param area area in the viewport coordinates of the complete layout
+     * @return keys and rectangles in device pixels relative to the page, the rectangle is null for a whole page
+     */
+    QList<QPair<ImageCache::Key, QRect>> tiles(int page, const QRect &area) const;
+
+    /**
+     * Hand the tiles missing in the cache to the render scheduler: base renders of the visible and next pages,
+     * then visible tiles, a margin around them and the neighbouring pages.
+     * Queued or running renders no longer needed are dropped, slotTileRendered() is called with the results.
+     */
+    void scheduleRenders();
+
+    /**
+     * Key of the low resolution render of the whole page, shown scaled at any zoom until the tiles are there.
+     * @param page page to get the key for
+     * @return key, resolution 0 marks base renders
+     */
+    static ImageCache::Key baseRenderKey(int page);
+
+    /**
+     * Add the job for the base render of the given page unless it is cached.
+     * @param jobs jobs to append to
+     * @param page page to render
+     * @param priority priority of the job
      */
-    QImage getPage(int page);
+    void addBaseRenderJob(QList<RenderScheduler::Job> &jobs, int page, RenderScheduler::Priority priority) const;
+
+    /**
+     * Is the given key one of a base render, see baseRenderKey()?
+     * @param key key to check
+     * @return base render?
+     */
+    static bool isBaseRender(const ImageCache::Key &key)
+    {
+        return key.resolution == 0.0;
+    }
+
+    /**
+     * Resolution the tiles are rendered with at the given zoom, without the device pixel ratio.
+     * Rounded to keep the cache keys stable, zooming in and out again must find the old renders despite rounding errors.
+     * @param zoom zoom to get the resolution for
+     * @return resolution for the X axis, the Y axis uses it scaled by m_dpiY / m_dpiX
+     */
+    qreal tileResolution(qreal zoom) const
+    {
+        return qRound(m_dpiX * zoom * 100.0) / 100.0;
+    }
+
+    /**
+     * Current vertical scroll velocity, measured over the last ScrollHistoryWindow milliseconds.
+     * @return velocity in pixels per second, positive downwards
+     */
+    qreal scrollVelocity() const;
+
+    /**
+     * Number of pages to prefetch before and after the visible ones.
+     * Symmetric if not scrolling, else only in scroll direction and the further the faster, paging via advance() and stepBack() counts as scrolling.
+     * Limited to what fits into the cache next to the visible tiles.
+     * @param visiblePages visible pages, not empty
+     * @return pages to prefetch before and after the visible ones
+     */
+    QPair<int, int> prefetchWindow(const QList<int> &visiblePages) const;
+
+    /**
+     * Remember the tiles of the given pages rendered at the given resolution, to show them scaled until the new renders arrive.
+     * @param pages pages to keep the tiles for
+     * @param resolution resolution the tiles were rendered at, see tileResolution()
+     */
+    void keepStaleTiles(const QList<int> &pages, qreal resolution);
+
+    /**
+     * Log the hits, misses and evictions of the render caches, enable via QT_LOGGING_RULES="firstaid.pageview.debug=true".
+     */
+    void logCacheStatistics() const;
 
 signals:
     void pageChanged(int page);
@@ -280,9 +423,41 @@ private:
     int m_currentPage = -1;
 
     /*
-     * cache for already created images, key is the page number
+     * cache for already created tiles, of all zoom levels, the least recently used are evicted
+     * budgeted in bytes, only used by the GUI thread, renderers hand over their results via slotTileRendered()
+     */
+    ImageCache m_imageCache;
+
+    /**
+     * low resolution renders of recently viewed pages, see baseRenderKey(), own budget to not be evicted by the tiles
      */
-    QCache<int, QImage> m_imageCache;
+    ImageCache m_baseRenders;
+
+    /**
+     * rendered tiles of visible pages too large for the cache
+     */
+    QHash<ImageCache::Key, QImage> m_oversizedTiles;
+
+    /**
+     * A tile rendered at another zoom, shown scaled.
+     */
+    struct StaleTile {
+        //! area in points relative to the page
+        QRectF rect;
+
+        //! rendered tile
+        QImage image;
+    };
+
+    /**
+     * tiles of visible pages at the zoom before the last change, shown scaled until the new renders arrive, key is the page
+     */
+    QHash<int, QList<StaleTile>> m_staleTiles;
+
+    /**
+     * background renders of missing tiles, by priority
+     */
+    RenderScheduler m_renderScheduler;
 
     /**
      * members for handling the rubber band
@@ -317,9 +492,30 @@ private:
     QTimer m_updateViewSizeTimer;
 
     /**
-     * delayed clearing of image cache
+     * delayed rendering in a new resolution after zooming
      */
-    QTimer m_clearImageCacheTimer;
+    QTimer m_zoomSettleTimer;
+
+    /**
+     * scrolling stopped once this triggers, see slotVerticalScrolled()
+     */
+    QTimer m_scrollStopTimer;
+
+    /**
+     * clock for the scroll history
+     */
+    QElapsedTimer m_scrollClock;
+
+    /**
+     * recent values of the vertical scrollbar with their time on m_scrollClock, oldest first
+     */
+    QList<QPair<qint64, int>> m_scrollHistory;
+
+    /**
+     * direction of the last advance() or stepBack(), 1 is downwards, 0 if none, and its time on m_scrollClock
+     */
+    int m_pagingDirection = 0;
+    qint64 m_pagingTime = 0;
 
     /**
      * area in the viewport to highlight via animation
@@ -327,7 +523,11 @@ private:
     QRect m_highlightRect;
     int m_highlightValue = 0;
 
-    QRecursiveMutex *m_mutex;
+    /**
+     * current search match as last announced, repainted once it changes, page -1 if none
+     */
+    int m_highlightedMatchPage = -1;
+    QRectF m_highlightedMatch;
 
     /**
      * a hint label displayed for small help texts
@@ -336,7 +536,7 @@ private:
     QTimer *m_hintLabelTimer = nullptr;
 
     /**
-     * bool set during zooming, reset when m_clearImageCacheTimer triggers
+     * bool set during zooming, reset when m_zoomSettleTimer triggers
      */
-    bool m_usePageRect = false;
+    bool m_zoomSettling = false;
 };
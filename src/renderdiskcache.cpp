@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * includes
+ */
+
+#include "renderdiskcache.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <vector>
+
+/*
+ * defines
+ */
+
+#define TileMagic quint32(0x46415443)
+#define TileVersion quint32(1)
+
+// default quota in megabytes
+#define DefaultRenderDiskCacheSize 128
+
+/*
+ * public methods
+ */
+
+RenderDiskCache::RenderDiskCache()
+    : m_directory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/renders"))
+    , m_quota(qint64(qMax(0, QSettings().value(QStringLiteral("PageView/renderDiskCacheSize"), DefaultRenderDiskCacheSize).toInt())) * 1024 * 1024)
+{
+}
+
+QImage RenderDiskCache::load(const QByteArray &fingerprint, const ImageCache::Key &key) const
+{
+    if (!isEnabled() || fingerprint.isEmpty())
+        return QImage();
+
+    // write access is needed to touch the file below, Windows refuses that for read only handles
+    QFile file(fileName(fingerprint, key));
+    if (!file.open(QFile::ReadWrite))
+        return QImage();
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    // check header, wrong version => ignore the file, it is overwritten or evicted later
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray data;
+    stream >> magic >> version >> data;
+    if (magic != TileMagic || version != TileVersion || stream.status() != QDataStream::Ok)
+        return QImage();
+
+    // mark as recently used for trim()
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return ImageCache::uncompressImage(data);
+}
+
+void RenderDiskCache::store(const QByteArray &fingerprint, const ImageCache::Key &key, const QImage &image)
+{
+    if (!isEnabled() || fingerprint.isEmpty() || image.isNull())
+        return;
+
+    const QString tileFile = fileName(fingerprint, key);
+    QDir().mkpath(QFileInfo(tileFile).absolutePath());
+
+    // write atomically, another instance might read the tile
+    QSaveFile file(tileFile);
+    if (!file.open(QSaveFile::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << TileMagic << TileVersion << ImageCache::compressImage(image);
+    if (stream.status() != QDataStream::Ok || !file.commit())
+        return;
+
+    // the first store computes the used bytes, replaced tiles are counted twice until the next trim()
+    if (m_size < 0 || (m_size += QFileInfo(tileFile).size()) > m_quota)
+        trim();
+}
+
+/*
+ * private methods
+ */
+
+QString RenderDiskCache::fileName(const QByteArray &fingerprint, const ImageCache::Key &key) const
+{
+    const QString documentDir = QString::fromLatin1(QCryptographicHash::hash(fingerprint, QCryptographicHash::Sha1).toHex());
+    return m_directory + QStringLiteral("/") + documentDir + QStringLiteral("/")
+        + QStringLiteral("%1-%2-%3-%4-%5-%6.tile")
+              .arg(key.page)
+              .arg(key.resolution, 0, 'f', 2)
+              .arg(key.devicePixelRatio, 0, 'f', 2)
+              .arg(key.renderHints)
+              .arg(key.tileX)
+              .arg(key.tileY);
+}
+
+void RenderDiskCache::trim()
+{
+    QMutexLocker locker(&m_trimMutex);
+
+    // another thread might have trimmed meanwhile
+    if (m_size >= 0 && m_size <= m_quota)
+        return;
+
+    struct Tile {
+        QString fileName;
+        QDateTime lastUsed;
+        qint64 size = 0;
+    };
+
+    std::vector<Tile> tiles;
+    qint64 size = 0;
+    QDirIterator it(m_directory, {QStringLiteral("*.tile")}, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        tiles.push_back(Tile{info.absoluteFilePath(), info.lastModified(), info.size()});
+        size += info.size();
+    }
+
+    // down to three quarters, else every store would trim again
+    if (size > m_quota) {
+        std::sort(tiles.begin(), tiles.end(), [](const Tile &a, const Tile &b) { return a.lastUsed < b.lastUsed; });
+        for (const Tile &tile : tiles) {
+            if (size <= m_quota / 4 * 3)
+                break;
+
+            if (QFile::remove(tile.fileName)) {
+                size -= tile.size;
+
+                // drops the directory of a document once its last tile is gone
+                QDir().rmdir(QFileInfo(tile.fileName).absolutePath());
+            }
+        }
+    }
+
+    m_size = size;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "imagecache.h"
+
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+
+/**
+ * On-disk cache for rendered tiles, survives restarts, a help viewer is opened for the same manual again and again.
+ * One file per tile in a directory per document, keyed by the fingerprint of the document file, see DocumentCache,
+ * and the tile key. Tiles are stored compressed via ImageCache::compressImage().
+ * The size is limited via PageView/renderDiskCacheSize in megabytes, 0 disables the cache,
+ * the least recently used tiles are removed first, using the file modification time that loading updates.
+ * Thread-safe, used by the render threads.
+ */
+class RenderDiskCache
+{
+public:
+    /**
+     * Construct the cache with the configured quota.
+     */
+    RenderDiskCache();
+
+    /**
+     * Is the cache enabled?
+     * @return enabled?
+     */
+    bool isEnabled() const
+    {
+        return m_quota > 0;
+    }
+
+    /**
+     * Load a tile.
+     * @param fingerprint fingerprint of the document file
+     * @param key tile to load
+     * @return image or a null image if not cached
+     */
+    QImage load(const QByteArray &fingerprint, const ImageCache::Key &key) const;
+
+    /**
+     * Store a tile, removes the least recently used tiles if the quota is exceeded.
+     * @param fingerprint fingerprint of the document file
+     * @param key tile to store
+     * @param image rendered tile
+     */
+    void store(const QByteArray &fingerprint, const ImageCache::Key &key, const QImage &image);
+
+private:
+    /**
+     * File for the given tile.
+     * @param fingerprint fingerprint of the document file
+     * @param key tile
+     * @return absolute file name
+     */
+    QString fileName(const QByteArray &fingerprint, const ImageCache::Key &key) const;
+
+    /**
+     * Remove the least recently used tiles until the cache is well below the quota.
+     * Recomputes the used bytes from the files on disk, other instances write there, too.
+     */
+    void trim();
+
+private:
+    /**
+     * directory holding one sub directory per document
+     */
+    const QString m_directory;
+
+    /**
+     * maximal bytes to use
+     */
+    qint64 m_quota = 0;
+
+    /**
+     * bytes used, -1 until first computed by trim()
+     */
+    std::atomic<qint64> m_size = -1;
+
+    /**
+     * serializes trim()
+     */
+    QMutex m_trimMutex;
+};
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "renderscheduler.h"
+
+#include <QSet>
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+
+/*
+ * public methods
+ */
+
+RenderScheduler::RenderScheduler(QObject *parent)
+    : QObject(parent)
+{
+    // 0 => one thread per core
+    const int threads = QSettings().value(QStringLiteral("PageView/renderThreads"), 0).toInt();
+    m_pool.setMaxThreadCount(threads > 0 ? threads : qMax(1, QThread::idealThreadCount()));
+}
+
+RenderScheduler::~RenderScheduler()
+{
+    stop();
+}
+
+void RenderScheduler::schedule(const QList<Job> &jobs)
+{
+    QSet<ImageCache::Key> wanted;
+    m_queue.clear();
+    for (const Job &job : jobs) {
+        wanted.insert(job.key);
+        if (m_running.contains(job.key))
+            continue;
+
+        // reuse a render no longer wanted if Poppler didn't abort it yet, else queue a new one
+        bool revived = false;
+        for (const auto &state : m_abandoned.values(job.key)) {
+            int expected = AbortRequested;
+            if (state->compare_exchange_strong(expected, Running)) {
+                m_abandoned.remove(job.key, state);
+                m_running.insert(job.key, state);
+                revived = true;
+                break;
+            }
+        }
+
+        if (!revived)
+            m_queue.append(job);
+    }
+
+    // abort running jobs no longer wanted
+    for (auto it = m_running.begin(); it != m_running.end();) {
+        if (wanted.contains(it.key())) {
+            ++it;
+            continue;
+        }
+
+        it.value()->store(AbortRequested);
+        m_abandoned.insert(it.key(), it.value());
+        it = m_running.erase(it);
+    }
+
+    // visible first, keep the order of the view within one priority
+    std::stable_sort(m_queue.begin(), m_queue.end(), [](const Job &a, const Job &b) { return a.priority < b.priority; });
+    startJobs();
+}
+
+void RenderScheduler::cancel()
+{
+    // no reviving, the pages might go away
+    m_queue.clear();
+    for (const auto &state : std::as_const(m_running))
+        state->store(Aborted);
+    for (const auto &state : std::as_const(m_abandoned))
+        state->store(Aborted);
+    m_running.clear();
+    m_abandoned.clear();
+}
+
+void RenderScheduler::stop()
+{
+    // aborted renders return fast, queued ones were never handed to the pool
+    cancel();
+    m_pool.waitForDone();
+}
+
+/*
+ * private methods
+ */
+
+bool RenderScheduler::shouldAbortRender(const QVariant &payload)
+{
+    // once we told Poppler to abort, the job can't be revived anymore
+    auto *state = static_cast<std::atomic<int> *>(payload.value<void *>());
+    int expected = AbortRequested;
+    return state->compare_exchange_strong(expected, Aborted) || expected != Running;
+}
+
+void RenderScheduler::startJobs()
+{
+    while (m_runningJobs < m_pool.maxThreadCount() && !m_queue.isEmpty()) {
+        const Job job = m_queue.takeFirst();
+        auto state = std::make_shared<std::atomic<int>>(Running);
+        m_running.insert(job.key, state);
+        ++m_runningJobs;
+
+        m_pool.start([this, job, state]() {
+            // reading a tile of an earlier session is far cheaper than rendering it
+            QImage image = m_diskCache.load(job.documentFingerprint, job.key);
+            const bool fromDisk = !image.isNull();
+            if (!fromDisk) {
+                const QVariant payload = QVariant::fromValue(static_cast<void *>(state.get()));
+                image = job.rect.isNull() ? job.page->renderToImage(job.resX, job.resY, -1, -1, -1, -1, Poppler::Page::Rotate0, nullptr, nullptr, shouldAbortRender, payload)
+                                          : job.page->renderToImage(job.resX, job.resY, job.rect.x(), job.rect.y(), job.rect.width(), job.rect.height(), Poppler::Page::Rotate0, nullptr, nullptr, shouldAbortRender, payload);
+                image.setDevicePixelRatio(job.key.devicePixelRatio);
+            }
+            QMetaObject::invokeMethod(this, [this, key = job.key, state, image]() { jobDone(key, state, image); }, Qt::QueuedConnection);
+
+            // write after handing over the image, aborted renders might be incomplete
+            if (!fromDisk && *state != Aborted)
+                m_diskCache.store(job.documentFingerprint, job.key, image);
+        });
+    }
+}
+
+void RenderScheduler::jobDone(const ImageCache::Key &key, const std::shared_ptr<std::atomic<int>> &state, const QImage &image)
+{
+    --m_runningJobs;
+
+    // aborted jobs might have an incomplete image, abandoned ones that finished before Poppler asked are fine but unwanted
+    if (*state == Running && m_running.value(key) == state) {
+        m_running.remove(key);
+        emit rendered(key, image);
+    } else
+        m_abandoned.remove(key, state);
+
+    startJobs();
+}
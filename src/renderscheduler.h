@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "imagecache.h"
+#include "renderdiskcache.h"
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QRect>
+#include <QThreadPool>
+
+#include <poppler-qt6.h>
+
+#include <atomic>
+#include <memory>
+
+/**
+ * Schedules the background renders of the page view by priority.
+ * The view hands over the complete list of tiles it wants after every change of the visible area,
+ * jobs no longer wanted are dropped from the queue and running ones are aborted via Poppler's abort callback.
+ * A tile is never rendered twice at once: wanting a tile that is still rendering reuses that render,
+ * even if it was about to be aborted, as long as Poppler didn't stop it yet.
+ * Jobs run in an own thread pool, as many at once as configured via PageView/renderThreads, default one per core,
+ * the others wait in priority order. Must be used from the GUI thread only.
+ * Jobs with a document fingerprint use the RenderDiskCache: a tile found there is not rendered, rendered ones are stored
+ * after handing them over.
+ */
+class RenderScheduler : public QObject
+{
+    Q_OBJECT
+
+    // checks the abort and revive of jobs
+    friend class RenderSchedulerTest;
+
+public:
+    /**
+     * Priorities of jobs, visible tiles render first.
+     */
+    enum Priority { Visible, Adjacent, Speculative };
+
+    /**
+     * A tile to render.
+     */
+    struct Job {
+        //! tile to render
+        ImageCache::Key key;
+
+        //! rectangle of the tile in device pixels relative to the page, null for the whole page
+        QRect rect;
+
+        //! horizontal resolution to render with, including the device pixel ratio
+        qreal resX = 72.0;
+
+        //! vertical resolution to render with, including the device pixel ratio
+        qreal resY = 72.0;
+
+        //! page to render, must stay valid until the job is done or stop() was called
+        Poppler::Page *page = nullptr;
+
+        //! priority
+        Priority priority = Speculative;
+
+        //! fingerprint of the document file for the disk cache, empty to not use it
+        QByteArray documentFingerprint;
+    };
+
+    /**
+     * Construct an idle scheduler.
+     * @param parent parent object
+     */
+    explicit RenderScheduler(QObject *parent = nullptr);
+
+    /**
+     * Abort all jobs and wait for them, see stop().
+     */
+    ~RenderScheduler();
+
+    /**
+     * Replace the wanted jobs.
+     * Jobs for tiles already running continue, running jobs for tiles no longer wanted are aborted.
+     * @param jobs wanted jobs, one per tile
+     */
+    void schedule(const QList<Job> &jobs);
+
+    /**
+     * Drop all queued jobs and abort the running ones, their results are never reported.
+     * Doesn't wait for the running jobs.
+     */
+    void cancel();
+
+    /**
+     * Cancel all jobs and wait until the running ones reacted on the abort.
+     * Afterwards no pages are in use, e.g. the document can be deleted.
+     */
+    void stop();
+
+signals:
+    /**
+     * A wanted job is done.
+     * @param key rendered tile
+     * @param image rendered image, HiDPI aware
+     */
+    void rendered(const ImageCache::Key &key, const QImage &image);
+
+private:
+    /**
+     * State of a running job, shared with the render thread.
+     */
+    enum JobState {
+        //! render and report the result
+        Running,
+
+        //! no longer wanted, can still be revived until Poppler asks whether to abort
+        AbortRequested,
+
+        //! Poppler was told to abort or the job was cancelled, the image is incomplete
+        Aborted
+    };
+
+    /**
+     * Poppler callback, aborts the render for jobs no longer wanted.
+     * @param payload pointer to the state of the job
+     * @return abort the render?
+     */
+    static bool shouldAbortRender(const QVariant &payload);
+
+    /**
+     * Start queued jobs in priority order while cores are free.
+     */
+    void startJobs();
+
+    /**
+     * Called in the GUI thread once a job is done.
+     * @param key rendered tile
+     * @param state state of the job
+     * @param image rendered image
+     */
+    void jobDone(const ImageCache::Key &key, const std::shared_ptr<std::atomic<int>> &state, const QImage &image);
+
+private:
+    /**
+     * queued jobs, sorted by priority
+     */
+    QList<Job> m_queue;
+
+    /**
+     * states of the running jobs that are still wanted
+     */
+    QHash<ImageCache::Key, std::shared_ptr<std::atomic<int>>> m_running;
+
+    /**
+     * states of the running jobs no longer wanted, revived if wanted again in time
+     */
+    QMultiHash<ImageCache::Key, std::shared_ptr<std::atomic<int>>> m_abandoned;
+
+    /**
+     * number of running jobs, including aborted ones not yet done
+     */
+    int m_runningJobs = 0;
+
+    /**
+     * rendered tiles of earlier sessions, used by the render threads
+     */
+    RenderDiskCache m_diskCache;
+
+    /**
+     * thread pool for the renders, not the global one to not block others or be blocked by them
+     * must be destroyed first, the running jobs use the disk cache
+     */
+    QThreadPool m_pool;
+};
@@ -98,6 +98,79 @@ void SearchEngine::reset()
     m_currentMatchIndex = 0;
 
     m_findText.clear();
+    m_findRunning = false;
+    m_findChangedPagesOnly = false;
+}
+
+void SearchEngine::slotDocumentChanged()
+{
+    // new document or nothing searched => start from scratch
+    Document *document = PdfViewer::document();
+    if (m_findText.isEmpty() || !document->keptUnchangedPages()) {
+        reset();
+        return;
+    }
+
+    // search still running => restart it on the new document, the pending find() continues
+    if (m_findRunning) {
+        m_matchesForPage.clear();
+        m_currentMatchPage = 0;
+        m_currentMatchPageIndex = 0;
+        m_currentMatchIndex = 0;
+
+        m_findCurrentPage = qBound(0, PdfViewer::view()->currentPage(), document->numPages() - 1);
+        m_findStartPage = m_findCurrentPage;
+        m_findPagesScanned = 0;
+        m_findChangedPagesOnly = false;
+
+        emit started();
+        return;
+    }
+
+    // keep the matches of unchanged pages, search the changed ones again in piles like any search
+    QHash<int, QList<QRectF>> matchesForPage;
+    for (auto it = m_matchesForPage.cbegin(); it != m_matchesForPage.cend(); ++it)
+        if (document->pageUnchanged(it.key()))
+            matchesForPage.insert(it.key(), it.value());
+    m_matchesForPage = matchesForPage;
+    updateCurrentMatch();
+
+    m_findCurrentPage = 0;
+    m_findStartPage = 0;
+    m_findPagesScanned = 0;
+    m_findRunning = true;
+    m_findChangedPagesOnly = true;
+
+    emit started();
+    find();
+}
+
+void SearchEngine::updateCurrentMatch()
+{
+    Document *document = PdfViewer::document();
+
+    // current match gone? use the next one, wrap around if needed
+    if (m_currentMatchPageIndex >= m_matchesForPage.value(m_currentMatchPage).count()) {
+        int nextPage = -1;
+        for (int page = m_currentMatchPage + 1; page < document->numPages() && nextPage < 0; page++)
+            if (m_matchesForPage.contains(page))
+                nextPage = page;
+        for (int page = 0; page <= m_currentMatchPage && nextPage < 0; page++)
+            if (m_matchesForPage.contains(page))
+                nextPage = page;
+
+        m_currentMatchPage = qMax(0, nextPage);
+        m_currentMatchPageIndex = 0;
+    }
+
+    // recount the index of the current match in document order
+    m_currentMatchIndex = 0;
+    if (!m_matchesForPage.isEmpty()) {
+        for (auto it = m_matchesForPage.cbegin(); it != m_matchesForPage.cend(); ++it)
+            if (it.key() < m_currentMatchPage)
+                m_currentMatchIndex += it.value().count();
+        m_currentMatchIndex += m_currentMatchPageIndex + 1;
+    }
 }
 
 void SearchEngine::find(const QString &text, bool caseSensitive, bool wholeWords)
@@ -127,6 +200,8 @@ void SearchEngine::find(const QString &text, bool caseSensitive, bool wholeWords
     m_findCurrentPage = PdfViewer::view()->currentPage();
     m_findStartPage = m_findCurrentPage;
     m_findPagesScanned = 0;
+    m_findRunning = true;
+    m_findChangedPagesOnly = false;
 
     find();
 }
@@ -221,14 +296,17 @@ void SearchEngine::find()
     bool delayAfterFirstMatch = false;
 
     for (int count = 0; count < PagePileSize; count++) {
-        // find our text on the current search page
-        Poppler::Page *p = PdfViewer::document()->page(m_findCurrentPage);
-        QList<QRectF> matches = p->search(m_findText, m_findFlags);
+        // find our text on the current search page, a refresh after a reload keeps the matches of unchanged pages
+        QList<QRectF> matches;
+        if (!m_findChangedPagesOnly || !PdfViewer::document()->pageUnchanged(m_findCurrentPage)) {
+            if (Poppler::Page *p = PdfViewer::document()->page(m_findCurrentPage))
+                matches = p->search(m_findText, m_findFlags);
+        }
 
         // signal matches and remember them
         if (!matches.isEmpty()) {
-            // first match? highlight it
-            if (m_matchesForPage.isEmpty()) {
+            // first match? highlight it, a refresh keeps the current match and recounts the index once done
+            if (m_matchesForPage.isEmpty() && !m_findChangedPagesOnly) {
                 m_currentMatchPage = m_findCurrentPage;
                 m_currentMatchPageIndex = 0;
                 m_currentMatchIndex = 1;
@@ -248,6 +326,10 @@ void SearchEngine::find()
         m_findPagesScanned++;
         int documentPages = PdfViewer::document()->numPages();
         if (m_findPagesScanned >= documentPages) {
+            if (m_findChangedPagesOnly)
+                updateCurrentMatch();
+            m_findRunning = false;
+            m_findChangedPagesOnly = false;
             emit finished();
             return;
         }
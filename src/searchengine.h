@@ -40,6 +40,7 @@ public:
 
 public slots:
     void reset();
+    void slotDocumentChanged();
 
     void find(const QString &text, bool caseSensitive = false, bool wholeWords = false);
     void nextMatch();
@@ -56,12 +57,17 @@ protected slots:
     void find();
 
 private:
+    // after a search refresh: pick the match nearest to the old current one and recount its index
+    void updateCurrentMatch();
+
     // members for finding text
     QString m_findText;
     Poppler::Page::SearchFlags m_findFlags = Poppler::Page::NoSearchFlags;
     int m_findCurrentPage = 0;
     int m_findStartPage = 0;
     int m_findPagesScanned = 0;
+    bool m_findRunning = false;
+    bool m_findChangedPagesOnly = false;
 
     // members for navigating in find results
     QHash<int, QList<QRectF>> m_matchesForPage;
@@ -128,28 +128,19 @@ void TocDock::fillInfo()
     }
 }
 
-QSet<QModelIndex> TocDock::fillToc(const QVector<Poppler::OutlineItem> &items, QStandardItem *parentItem)
+QSet<QModelIndex> TocDock::fillToc(const QVector<Document::TocItem> &items, QStandardItem *parentItem)
 {
     QSet<QModelIndex> openIndices;
 
     for (const auto &item : items) {
         // tag name == link name, strange enough
-        QStandardItem *labelItem = new QStandardItem(item.name());
+        QStandardItem *labelItem = new QStandardItem(item.title);
         labelItem->setFlags(labelItem->flags() & ~Qt::ItemIsEditable);
 
-        /**
-         * use raw string for destination or convert the named one
-         */
-        QString destination;
-        if (item.destination()) {
-            if (item.destination()->pageNumber() > 0)
-                destination = item.destination()->toString();
-        }
-
         // skip destination building if not there
         int pageNumber = 0;
-        if (!destination.isEmpty()) {
-            Poppler::LinkDestination link(destination);
+        if (!item.destination.isEmpty()) {
+            Poppler::LinkDestination link(item.destination);
             pageNumber = link.pageNumber();
 
             // remember link string representation
@@ -167,11 +158,11 @@ QSet<QModelIndex> TocDock::fillToc(const QVector<Poppler::OutlineItem> &items, Q
 
         m_pageToIndexMap.insert(pageNumber, labelItem->index());
 
-        if (item.isOpen())
+        if (item.open)
             openIndices << labelItem->index();
 
-        if (item.hasChildren())
-            openIndices += fillToc(item.children(), labelItem);
+        if (!item.children.isEmpty())
+            openIndices += fillToc(item.children, labelItem);
 
         // adjust filter role
         QStringList filterRoles;
@@ -23,7 +23,7 @@
 #include <QHash>
 #include <QModelIndex>
 
-#include <poppler-qt6.h>
+#include "document.h"
 
 class QLineEdit;
 class QSortFilterProxyModel;
@@ -44,7 +44,7 @@ signals:
 
 protected:
     void fillInfo();
-    QSet<QModelIndex> fillToc(const QVector<Poppler::OutlineItem> &items, QStandardItem *parentItem = nullptr);
+    QSet<QModelIndex> fillToc(const QVector<Document::TocItem> &items, QStandardItem *parentItem = nullptr);
 
 protected slots:
     void documentChanged();
@@ -24,6 +24,7 @@
 #include "viewer.h"
 
 #include "config.h"
+#include "documentcache.h"
 #include "findbar.h"
 #include "helpdialog.h"
 #include "main.h"
@@ -43,6 +44,7 @@
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QFileDialog>
+#include <QFutureWatcher>
 #include <QFileInfo>
 #include <QMenu>
 #include <QMenuBar>
@@ -55,7 +57,6 @@
 #include <QProgressDialog>
 #include <QStackedWidget>
 #include <QTcpSocket>
-#include <QThreadPool>
 #include <QVBoxLayout>
 #include <QWindow>
 
@@ -67,8 +68,16 @@
 
 PdfViewer *PdfViewer::s_instance = nullptr;
 
-PdfViewer::PdfViewer(const QString &file, quint16 tcpPort)
+// absolute and if possible canonical path, to compare files and to have a full url for later external open
+static QString normalizedFilePath(const QString &file)
+{
+    const QString canonicalPath = QFileInfo(file).canonicalFilePath();
+    return canonicalPath.isEmpty() ? QFileInfo(file).absoluteFilePath() : canonicalPath;
+}
+
+PdfViewer::PdfViewer(const QString &file, quint16 tcpPort, bool resident)
     : QMainWindow()
+    , m_resident(resident)
 {
     // register singleton
     s_instance = this;
@@ -137,7 +146,7 @@ PdfViewer::PdfViewer(const QString &file, quint16 tcpPort)
     NavigationToolBar *navbar = new NavigationToolBar(tocDock->toggleViewAction(), menu, this);
     addToolBar(navbar);
 
-    connect(&m_document, &Document::documentChanged, &m_searchEngine, &SearchEngine::reset);
+    connect(&m_document, &Document::documentChanged, &m_searchEngine, &SearchEngine::slotDocumentChanged);
 
     /**
      * auto-reload
@@ -187,6 +196,9 @@ PdfViewer::PdfViewer(const QString &file, quint16 tcpPort)
 
 PdfViewer::~PdfViewer()
 {
+    // don't wait for a load no one will see
+    cancelLoading();
+
     // close document, doesn't delete the m_document and we need m_view here
     closeDocument();
 
@@ -199,12 +211,8 @@ PdfViewer::~PdfViewer()
 
 void PdfViewer::loadDocument(QString file, bool forceReload)
 {
-    // absolute path in any case, to have full url for later external open!
-    file = QFileInfo(file).absoluteFilePath();
-
-    // try to canonicalize, might fail if not there
-    if (!QFileInfo(file).canonicalFilePath().isEmpty())
-        file = QFileInfo(file).canonicalFilePath();
+    // absolute path in any case, canonical if the file is there
+    file = normalizedFilePath(file);
 
     // bail out early if file does not exist
     if (!QFileInfo(file).exists()) {
@@ -219,73 +227,187 @@ void PdfViewer::loadDocument(QString file, bool forceReload)
         return;
     }
 
+    // the newest request wins, an older load stops at its next check and is never shown
+    cancelLoading();
+
+    // reload of the current document => keep showing the old one until the new one is prepared
+    const bool reload = (file == m_filePath) && m_document.isValid();
+
     // cleanup old document
-    closeDocument();
+    if (!reload)
+        closeDocument();
 
-    QProgressDialog *pd = new QProgressDialog(this);
-    pd->setWindowModality(Qt::WindowModal);
-    pd->setCancelButton(nullptr);
-    pd->setMinimumDuration(2000);
-    pd->setLabelText(QStringLiteral("Loading document..."));
-    pd->setRange(0, 0);
-
-    // try to load the document
-    m_loadingFile = true;
-    QtConcurrent::run([file]() { return Poppler::Document::load(file); }).then(this, [this, file, pd](std::unique_ptr<Poppler::Document> newdoc) {
-        if (!newdoc || newdoc->isLocked()) {
-            // delete progress dialog
-            delete pd;
-
-            // show message
-            QMessageBox::critical(this, tr("Cannot open file"), tr("Cannot open file '%1'.").arg(file));
-            return;
+    // page to show first: a pending goto command or the last visible one for the file, only its size must be exact to show it
+    int page = 0;
+    if (!reload) {
+        bool ok = false;
+        if (!m_pendingCommands.isEmpty() && m_pendingCommands.first().startsWith(QLatin1String("goto ")))
+            page = m_pendingCommands.first().mid(5).toInt(&ok) - 1;
+        if (!ok) {
+            QSettings settings;
+            settings.beginGroup(QStringLiteral("Files"));
+            page = settings.value(QString::fromUtf8(file.toUtf8().toPercentEncoding()), 0).toInt();
+            settings.endGroup();
         }
+    }
+
+    // a document shown before might still be resident, only the Poppler document is loaded again, no measuring and no renders needed
+    std::optional<DocumentPool::Entry> resident;
+    if (!reload)
+        resident = m_documentPool.take(file);
+    const std::shared_ptr<PageView::Renders> residentRenders = resident ? std::make_shared<PageView::Renders>(std::move(resident->renders)) : nullptr;
+
+    // not modal, opening another document meanwhile aborts this load, a hidden resident window loads silently
+    QProgressDialog *pd = nullptr;
+    if (!reload && !(m_resident && isHidden())) {
+        pd = new QProgressDialog(this);
+        pd->setWindowModality(Qt::NonModal);
+        pd->setMinimumDuration(2000);
+        pd->setLabelText(QStringLiteral("Loading document..."));
+        pd->setRange(0, 0);
+        connect(pd, &QProgressDialog::canceled, this, [this]() {
+            cancelLoading();
+            QTimer::singleShot(0, this, &PdfViewer::processCommands);
+        });
+    }
 
-        // pass loaded poppler document to our internal one
-        m_document.setDocument(std::move(newdoc), pd);
+    // memory map the file if wanted, we fall back to normal loading if that fails
+    std::shared_ptr<MappedFile> mappedFile;
+    if (QSettings().value(QStringLiteral("Document/memoryMap"), false).toBool())
+        mappedFile = MappedFile::map(file);
+
+    // try to load and prepare the document in the background, commands wait for a new document but not for a reload
+    if (reload)
+        m_reloadingFile = true;
+    else
+        m_loadingFile = true;
+    m_loadingFilePath = file;
+    if (resident)
+        m_loading = QtConcurrent::run(&m_loadingPool, &Document::restore, std::move(resident->prepared), mappedFile);
+    else
+        m_loading = QtConcurrent::run(&m_loadingPool, &Document::prepare, file, mappedFile, reload, page);
+    m_loadingProgress = pd;
+    if (pd) {
+        auto watcher = new QFutureWatcher<std::unique_ptr<Document::Prepared>>(pd);
+        connect(watcher, &QFutureWatcherBase::progressRangeChanged, pd, &QProgressDialog::setRange);
+        connect(watcher, &QFutureWatcherBase::progressValueChanged, pd, &QProgressDialog::setValue);
+        connect(watcher, &QFutureWatcherBase::progressTextChanged, pd, &QProgressDialog::setLabelText);
+        watcher->setFuture(m_loading);
+    }
+
+    // not called if canceled in time, else the serial tells
+    const quint64 serial = ++m_loadingSerial;
+    m_loading.then(this, [this, file, reload, progress = QPointer<QProgressDialog>(pd), page, serial, residentRenders](std::unique_ptr<Document::Prepared> prepared) {
+        if (serial != m_loadingSerial)
+            return;
 
         // delete progress dialog
-        delete pd;
+        delete progress;
+
+        if (!prepared) {
+            // a failed reload keeps the old document, the file might be still written, watch again to retry on the next change
+            if (reload) {
+                m_reloadingFile = false;
+                m_fileWatcher.addPath(m_filePath);
+                QTimer::singleShot(0, this, &PdfViewer::processCommands);
+                return;
+            }
 
-        // set file + watch
-        m_filePath = file;
-        m_fileWatcher.addPath(m_filePath);
+            // the file of a resident document changed meanwhile => load it from scratch
+            m_loadingFile = false;
+            if (residentRenders) {
+                loadDocument(file, true);
+                return;
+            }
 
-        // update action state & co.
-        updateOnDocumentChange();
+            // show message, the commands for the document are handled without it
+            QMessageBox::critical(this, tr("Cannot open file"), tr("Cannot open file '%1'.").arg(file));
+            QTimer::singleShot(0, this, &PdfViewer::processCommands);
+            return;
+        }
 
-        // determine last visible page for the current file
-        QSettings settings;
-        settings.beginGroup(QStringLiteral("Files"));
-        int page = settings.value(QString::fromUtf8(m_filePath.toUtf8().toPercentEncoding()), 0).toInt();
-        settings.endGroup();
+        if (reload) {
+            // the old document goes away now, abort the still running background renderers
+            m_view->stopRendering();
 
-        // queue goto page request as on startup there may be some signals still flying around
-        QMainWindow::metaObject()->invokeMethod(m_view, "gotoPage", Qt::QueuedConnection, Q_ARG(int, page));
+            // swap in the new document and stay where we are, the zoom is kept by the view
+            const QPoint offset = m_view->offset();
+            m_document.setDocument(std::move(prepared));
+            m_view->setOffset(offset);
+
+            // watch again, a replaced file is no longer watched
+            m_fileWatcher.addPath(m_filePath);
+
+            // update action state & co.
+            updateOnDocumentChange();
+        } else {
+            showDocument(file, std::move(prepared), page);
+            if (residentRenders)
+                m_view->restoreRenders(std::move(*residentRenders));
+        }
 
         // we are no longer loading
         m_loadingFile = false;
+        m_reloadingFile = false;
 
         // check of there are command to process
         QTimer::singleShot(0, this, [this]() { processCommands(); });
     });
 }
 
+void PdfViewer::showDocument(const QString &file, std::unique_ptr<Document::Prepared> prepared, int page)
+{
+    // pass prepared document to our internal one
+    m_document.setDocument(std::move(prepared));
+
+    // set file + watch
+    m_filePath = file;
+    m_fileWatcher.addPath(m_filePath);
+
+    // update action state & co.
+    updateOnDocumentChange();
+
+    // queue goto page request as on startup there may be some signals still flying around
+    QMainWindow::metaObject()->invokeMethod(m_view, "gotoPage", Qt::QueuedConnection, Q_ARG(int, page));
+
+    // a hidden resident window gets no paint events that would trigger the renders
+    if (m_resident && isHidden())
+        QMetaObject::invokeMethod(m_view, [this, page]() { m_view->preload(page); }, Qt::QueuedConnection);
+}
+
+void PdfViewer::cancelLoading()
+{
+    if (!m_loadingFile && !m_reloadingFile)
+        return;
+
+    // the load stops at its next check, e.g. the next page, and frees its thread
+    m_loading.cancel();
+    ++m_loadingSerial;
+    if (m_loadingProgress)
+        m_loadingProgress->deleteLater();
+    m_loadingFile = false;
+    m_reloadingFile = false;
+}
+
 void PdfViewer::closeDocument()
 {
     if (!m_document.isValid())
         return;
 
-    // drain the thread pool with the potential still running background renderers
-    QThreadPool::globalInstance()->clear();
-    QThreadPool::globalInstance()->waitForDone();
+    // abort the still running background renderers
+    m_view->stopRendering();
 
     QSettings settings;
     settings.beginGroup(QStringLiteral("Files"));
     settings.setValue(QString::fromUtf8(m_filePath.toUtf8().toPercentEncoding()), m_view->currentPage());
     settings.endGroup();
 
-    m_document.setDocument(nullptr);
+    // keep it resident for switching back, a truncated mapping must not be touched anymore
+    if (m_documentPool.isEnabled() && !m_document.mappedFileTruncated()) {
+        PageView::Renders renders = m_view->takeRenders();
+        m_documentPool.insert(m_filePath, m_document.takeDocument(), std::move(renders));
+    } else
+        m_document.setDocument(nullptr);
 
     // remove path
     m_fileWatcher.removePath(m_filePath);
@@ -308,6 +430,20 @@ void PdfViewer::receiveCommand()
             m_pendingCommands << trimmedLine;
     }
 
+    // an open of another file makes a running load stale, together with the commands queued for it
+    // reloads don't block commands, an open of another file cancels them when it is processed
+    if (m_loadingFile) {
+        int lastOpen = -1;
+        for (int i = 0; i < m_pendingCommands.size(); ++i)
+            if (m_pendingCommands.at(i).startsWith(QLatin1String("open ")))
+                lastOpen = i;
+
+        if (lastOpen >= 0 && normalizedFilePath(m_pendingCommands.at(lastOpen).mid(5)) != m_loadingFilePath) {
+            cancelLoading();
+            m_pendingCommands = m_pendingCommands.mid(lastOpen);
+        }
+    }
+
     // when not loading a document we can process the command
     if (!m_loadingFile)
         QTimer::singleShot(0, this, &PdfViewer::processCommands);
@@ -328,24 +464,26 @@ void PdfViewer::processCommands()
 
     if (command.startsWith(QLatin1String("open "))) {
         loadDocument(command.mid(5));
-        activate = true;
+
+        // a hidden resident window just preloads, goto or activate show it
+        activate = !(m_resident && isHidden());
     }
 
     else if (command.startsWith(QLatin1String("goto "))) {
+        // a hidden resident window gets its final size first, the view is positioned for it
+        if (m_resident && isHidden())
+            show();
+
         const QString target = command.mid(5);
         bool ok = false;
         const int pageNumber = target.toInt(&ok);
         if (ok)
             m_view->gotoPage(pageNumber - 1);
         else {
+            // first valid candidate wins, resolved only once
             for (const QString &t : target.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
-                bool valid = false;
-                if (auto linkDest = (document()->linkDestination(t))) {
-                    valid = linkDest->pageNumber() > 0;
-                }
-
-                if (valid) {
-                    m_view->gotoDestinationName(t, true, false);
+                if (const QString destination = document()->resolveDestination(t); !destination.isEmpty()) {
+                    m_view->gotoDestination(destination, true, false);
                     break;
                 }
             }
@@ -375,6 +513,7 @@ void PdfViewer::processCommands()
 #endif
 
         setWindowState(windowState() & ~Qt::WindowMinimized);
+        show();
         raise();
         activateWindow();
     }
@@ -391,6 +530,14 @@ void PdfViewer::closeEvent(QCloseEvent *event)
     QSettings settings;
     settings.setValue(QStringLiteral("MainWindow/geometry"), saveGeometry());
     settings.setValue(QStringLiteral("MainWindow/windowState"), saveState());
+
+    // resident => closing by the user only hides the window, the quit action and the close command end the program
+    if (m_resident && event->spontaneous()) {
+        event->ignore();
+        hide();
+        return;
+    }
+
     QMainWindow::closeEvent(event);
 }
 
@@ -433,6 +580,13 @@ void PdfViewer::slotReload()
 
 void PdfViewer::slotDelayedReload()
 {
+    // cached document data is outdated now
+    DocumentCache::remove(m_filePath);
+
+    // a memory mapped file that got truncated in place must not be touched anymore, close at once, reload will follow
+    if (m_document.mappedFileTruncated())
+        closeDocument();
+
     // restart singleshot timer => 1 second later we will reload
     m_fileWatcherReloadTimer.start();
 }
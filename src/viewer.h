@@ -21,13 +21,19 @@
 #pragma once
 
 #include "document.h"
+#include "documentpool.h"
 #include "pageview.h"
 #include "searchengine.h"
 
 #include <QFileSystemWatcher>
+#include <QFuture>
 #include <QMainWindow>
+#include <QPointer>
+#include <QThreadPool>
 #include <QTimer>
 
+class QProgressDialog;
+
 class QAction;
 class QActionGroup;
 class QLabel;
@@ -49,8 +55,9 @@ public:
      * Construct viewer image, is a singleton.
      * @param file file to open, if not empty
      * @param startTcpServer start a tcp server to receive commands
+     * @param resident start hidden and stay running, the window is shown by commands and closing it only hides it
      */
-    PdfViewer(const QString &file, quint16 tcpPort);
+    PdfViewer(const QString &file, quint16 tcpPort, bool resident = false);
 
     /**
      * Destruct the viewer window.
@@ -100,6 +107,11 @@ public:
     void loadDocument(QString file, bool forceReload = false);
     void closeDocument();
 
+    /**
+     * Abort a running load, its result is never shown and the old document stays.
+     */
+    void cancelLoading();
+
     void closeEvent(QCloseEvent *e) override;
 
     /**
@@ -130,12 +142,25 @@ private:
      */
     void updateOnDocumentChange();
 
+    /**
+     * Show a prepared document instead of the current one, which must be closed already.
+     * @param file file the document was loaded from
+     * @param prepared document to show
+     * @param page page to go to
+     */
+    void showDocument(const QString &file, std::unique_ptr<Document::Prepared> prepared, int page);
+
 private:
     /**
      *
      */
     static PdfViewer *s_instance;
 
+    /**
+     * resident mode: started hidden and preloaded, waits for commands to show up, see constructor
+     */
+    const bool m_resident = false;
+
     /**
      * full path to current open document, else empty
      */
@@ -171,6 +196,11 @@ private:
      */
     Document m_document;
 
+    /**
+     * documents shown before, kept for switching back to them, see closeDocument()
+     */
+    DocumentPool m_documentPool;
+
     /**
      * search engine
      */
@@ -190,4 +220,34 @@ private:
      * Flag set while a document is being loaded.
      */
     bool m_loadingFile = false;
+
+    /**
+     * Flag set while the current document is reloaded in the background, commands still use the current one.
+     */
+    bool m_reloadingFile = false;
+
+    /**
+     * file of the running load or reload
+     */
+    QString m_loadingFilePath;
+
+    /**
+     * the running load, see Document::prepare(), canceled by a newer one
+     */
+    QFuture<std::unique_ptr<Document::Prepared>> m_loading;
+
+    /**
+     * progress of the running load, not for reloads
+     */
+    QPointer<QProgressDialog> m_loadingProgress;
+
+    /**
+     * counts loads and cancellations, a load finished meanwhile must not show up if canceled too late
+     */
+    quint64 m_loadingSerial = 0;
+
+    /**
+     * thread pool for loading documents, renders and other background work can't stall loading
+     */
+    QThreadPool m_loadingPool;
 };
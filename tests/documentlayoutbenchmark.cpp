@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "document.h"
+
+#include <QTest>
+
+#include <memory>
+
+/*
+ * defines
+ */
+
+// viewport used for the lookups, roughly a maximized window at 100%
+#define ViewportWidth 1200
+#define ViewportHeight 1500
+
+// scroll positions spread over the layout per benchmark iteration
+#define LookupPositions 1000
+
+/*
+ * helpers
+ */
+
+/**
+ * Prepare a document with the given number of pages without parsing a PDF of that size, as if taken from the document cache.
+ * Poppler only provides the title, the layout uses the page sizes alone: A4 portrait, every tenth page landscape.
+ * @param pages number of pages
+ * @return prepared document for Document::setDocument()
+ */
+static std::unique_ptr<Document::Prepared> preparedDocument(int pages)
+{
+    const QList<QByteArray> objects = {
+        QByteArrayLiteral("<< /Type /Catalog /Pages 2 0 R >>"),
+        QByteArrayLiteral("<< /Type /Pages /Kids [3 0 R] /Count 1 >>"),
+        QByteArrayLiteral("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 595 842] >>"),
+    };
+
+    QByteArray pdf = QByteArrayLiteral("%PDF-1.4\n");
+    QList<qsizetype> offsets;
+    for (int i = 0; i < objects.size(); ++i) {
+        offsets.append(pdf.size());
+        pdf += QByteArray::number(i + 1) + " 0 obj\n" + objects.at(i) + "\nendobj\n";
+    }
+
+    const qsizetype xref = pdf.size();
+    pdf += "xref\n0 " + QByteArray::number(objects.size() + 1) + "\n0000000000 65535 f \n";
+    for (const qsizetype offset : offsets)
+        pdf += QByteArray::number(offset).rightJustified(10, '0') + " 00000 n \n";
+    pdf += "trailer\n<< /Size " + QByteArray::number(objects.size() + 1) + " /Root 1 0 R >>\nstartxref\n" + QByteArray::number(xref) + "\n%%EOF\n";
+
+    auto prepared = std::make_unique<Document::Prepared>();
+    prepared->document = Poppler::Document::loadFromData(pdf);
+    if (!prepared->document)
+        return nullptr;
+
+    prepared->fromCache = true;
+    prepared->links.resize(pages);
+    for (int i = 0; i < pages; ++i)
+        prepared->pageSizes << (i % 10 == 9 ? QSizeF(842, 595) : QSizeF(595, 842));
+    return prepared;
+}
+
+/**
+ * Measures the layout and the lookups of pages in it for documents up to 100000 pages, single and double sided.
+ * The lookups are the hot path of every paint and mouse move of the page view.
+ */
+class DocumentLayoutBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * Data for all benchmarks.
+     */
+    void addLayoutData()
+    {
+        QTest::addColumn<int>("pages");
+        QTest::addColumn<bool>("doubleSided");
+
+        for (const int pages : {100, 1000, 10000, 100000}) {
+            QTest::addRow("%d pages", pages) << pages << false;
+            QTest::addRow("%d pages, double sided", pages) << pages << true;
+        }
+    }
+
+    /**
+     * Setup the document for the current data row.
+     * @param document document to setup
+     */
+    void setupDocument(Document &document)
+    {
+        QFETCH(int, pages);
+        QFETCH(bool, doubleSided);
+
+        std::unique_ptr<Document::Prepared> prepared = preparedDocument(pages);
+        QVERIFY(prepared);
+        document.setDocument(std::move(prepared));
+        document.setDoubleSided(doubleSided);
+        QCOMPARE(document.numPages(), pages);
+    }
+
+private slots:
+    void relayout_data()
+    {
+        addLayoutData();
+    }
+
+    void relayout()
+    {
+        Document document;
+        setupDocument(document);
+        if (QTest::currentTestFailed())
+            return;
+
+        QBENCHMARK {
+            document.relayout();
+        }
+    }
+
+    void visiblePages_data()
+    {
+        addLayoutData();
+    }
+
+    void visiblePages()
+    {
+        Document document;
+        setupDocument(document);
+        if (QTest::currentTestFailed())
+            return;
+
+        const qreal step = document.layoutSize().height() / LookupPositions;
+        qsizetype found = 0;
+        QBENCHMARK {
+            for (int i = 0; i < LookupPositions; ++i)
+                found += document.visiblePages(QRectF(0, i * step, ViewportWidth, ViewportHeight)).size();
+        }
+        QVERIFY(found > 0);
+    }
+
+    void pageForPoint_data()
+    {
+        addLayoutData();
+    }
+
+    void pageForPoint()
+    {
+        Document document;
+        setupDocument(document);
+        if (QTest::currentTestFailed())
+            return;
+
+        const qreal step = document.layoutSize().height() / LookupPositions;
+        const qreal x = document.layoutSize().width() / 2;
+        int found = 0;
+        QBENCHMARK {
+            for (int i = 0; i < LookupPositions; ++i)
+                found += document.pageForPoint(QPointF(x, i * step)) >= 0;
+        }
+        QVERIFY(found > 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(DocumentLayoutBenchmark)
+
+#include "documentlayoutbenchmark.moc"
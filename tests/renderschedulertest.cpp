@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2026, agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "renderscheduler.h"
+
+#include <QSignalSpy>
+#include <QTest>
+#include <QThread>
+
+#include <memory>
+
+/*
+ * helpers
+ */
+
+/**
+ * Build a one page PDF with enough content to keep a render busy for a while, Poppler asks often whether to abort.
+ * @return PDF data
+ */
+static QByteArray busyPdf()
+{
+    QByteArray content;
+    for (int y = 0; y < 80; ++y)
+        for (int x = 0; x < 60; ++x)
+            content += QByteArray::number(x * 10) + ' ' + QByteArray::number(y * 10) + " 8 8 re f\n";
+
+    const QList<QByteArray> objects = {
+        QByteArrayLiteral("<< /Type /Catalog /Pages 2 0 R >>"),
+        QByteArrayLiteral("<< /Type /Pages /Kids [3 0 R] /Count 1 >>"),
+        QByteArrayLiteral("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 600 800] /Contents 4 0 R >>"),
+        "<< /Length " + QByteArray::number(content.size()) + " >>\nstream\n" + content + "endstream",
+    };
+
+    // objects with a valid cross-reference table, Poppler would repair a broken one, but that would hide errors
+    QByteArray pdf = QByteArrayLiteral("%PDF-1.4\n");
+    QList<qsizetype> offsets;
+    for (int i = 0; i < objects.size(); ++i) {
+        offsets.append(pdf.size());
+        pdf += QByteArray::number(i + 1) + " 0 obj\n" + objects.at(i) + "\nendobj\n";
+    }
+
+    const qsizetype xref = pdf.size();
+    pdf += "xref\n0 " + QByteArray::number(objects.size() + 1) + "\n0000000000 65535 f \n";
+    for (const qsizetype offset : offsets)
+        pdf += QByteArray::number(offset).rightJustified(10, '0') + " 00000 n \n";
+    pdf += "trailer\n<< /Size " + QByteArray::number(objects.size() + 1) + " /Root 1 0 R >>\nstartxref\n" + QByteArray::number(xref) + "\n%%EOF\n";
+    return pdf;
+}
+
+/**
+ * Tests that a job no longer wanted can be revived as long as Poppler didn't abort it, and only then.
+ */
+class RenderSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        // own settings, the scheduler reads the thread count from them
+        QCoreApplication::setOrganizationName(QStringLiteral("AbsInt"));
+        QCoreApplication::setApplicationName(QStringLiteral("RenderSchedulerTest"));
+
+        m_document = Poppler::Document::loadFromData(busyPdf());
+        QVERIFY(m_document);
+        QCOMPARE(m_document->numPages(), 1);
+        m_page = m_document->page(0);
+        QVERIFY(m_page);
+    }
+
+    void cleanupTestCase()
+    {
+        m_page.reset();
+        m_document.reset();
+    }
+
+    /**
+     * The state machine behind shouldAbortRender(), the way schedule() revives a job.
+     */
+    void abortThenRevive()
+    {
+        std::atomic<int> state = RenderScheduler::Running;
+        const QVariant payload = QVariant::fromValue(static_cast<void *>(&state));
+
+        // still wanted => render on
+        QVERIFY(!RenderScheduler::shouldAbortRender(payload));
+        QCOMPARE(state.load(), int(RenderScheduler::Running));
+
+        // abort requested, revived before Poppler asked => render on, the image is complete
+        state = RenderScheduler::AbortRequested;
+        int expected = RenderScheduler::AbortRequested;
+        QVERIFY(state.compare_exchange_strong(expected, RenderScheduler::Running));
+        QVERIFY(!RenderScheduler::shouldAbortRender(payload));
+        QCOMPARE(state.load(), int(RenderScheduler::Running));
+
+        // abort requested, Poppler asked first => aborted for good, reviving must fail
+        state = RenderScheduler::AbortRequested;
+        QVERIFY(RenderScheduler::shouldAbortRender(payload));
+        QCOMPARE(state.load(), int(RenderScheduler::Aborted));
+        expected = RenderScheduler::AbortRequested;
+        QVERIFY(!state.compare_exchange_strong(expected, RenderScheduler::Running));
+        QVERIFY(RenderScheduler::shouldAbortRender(payload));
+
+        // cancelled => aborted, too
+        state = RenderScheduler::Aborted;
+        QVERIFY(RenderScheduler::shouldAbortRender(payload));
+    }
+
+    /**
+     * Race the abort and the revive against real renders: whoever wins, the tile is reported exactly once and complete.
+     */
+    void abortThenReviveRace()
+    {
+        RenderScheduler scheduler;
+        QSignalSpy spy(&scheduler, &RenderScheduler::rendered);
+
+        for (int round = 0; round < 50; ++round) {
+            spy.clear();
+            RenderScheduler::Job job;
+            job.key = ImageCache::Key{0, 72.0 + round, 1.0, 0, 0, 0};
+            job.resX = job.resY = job.key.resolution;
+            job.page = m_page.get();
+            job.priority = RenderScheduler::Visible;
+
+            // wanted, unwanted, wanted again, the render thread runs meanwhile
+            scheduler.schedule({job});
+            if (round % 2)
+                QThread::usleep(round * 20);
+            scheduler.schedule({});
+            scheduler.schedule({job});
+
+            QTRY_COMPARE(scheduler.m_runningJobs, 0);
+            QCOMPARE(spy.count(), 1);
+            QVERIFY(scheduler.m_running.isEmpty());
+            QVERIFY(scheduler.m_abandoned.isEmpty());
+
+            // an aborted render would miss the last rectangles, compare against an undisturbed one
+            const QImage image = spy.at(0).at(1).value<QImage>();
+            QCOMPARE(image, m_page->renderToImage(job.resX, job.resY));
+        }
+    }
+
+private:
+    std::unique_ptr<Poppler::Document> m_document;
+    std::unique_ptr<Poppler::Page> m_page;
+};
+
+QTEST_GUILESS_MAIN(RenderSchedulerTest)
+
+#include "renderschedulertest.moc"